@@ -0,0 +1,445 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* encoder benchmarks */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "c2fxp.h"
+#include "c2cache.h"
+#include "c2stream.h"
+
+#define SECONDS 10
+#define RUNS    5
+#define F0      140 /* Hz, test signal pitch */
+
+static const uint32_t pitches[] = { 90, F0, 220 }; /* Hz, pitch benchmark */
+
+static const struct c2enc_config_s configs[] = /* resolution benchmark */
+{
+  { 128, 5, C2ENC_PITCH_NLP }, { 256, 5, C2ENC_PITCH_NLP }, { 512, 5, C2ENC_PITCH_NLP },
+  { 1024, 5, C2ENC_PITCH_NLP }, { 256, 4, C2ENC_PITCH_NLP }, { 512, 2, C2ENC_PITCH_NLP },
+  { 1024, 1, C2ENC_PITCH_NLP }
+};
+
+#ifdef C2FXP_NLP_Q31
+#define PRECISION "Q31"
+#else
+#define PRECISION "Q15"
+#endif
+
+struct c2enc_context_s ctx;
+
+/* ========================================================================== */
+/* Harmonic rich test signal: f0 sawtooth, amplitude 0.25 */
+static int16_t *bench_signal(uint32_t rate, uint32_t f0, uint32_t *nsamples)
+{
+  uint32_t n = rate * SECONDS;
+  int16_t *buf = malloc(n * sizeof(int16_t));
+  uint32_t i;
+  uint32_t ph = 0;
+  uint32_t step = (uint32_t)(((uint64_t)f0 << 32) / rate);
+
+  if(!buf)
+    {
+      return NULL;
+    }
+
+  for(i=0; i<n; i++)
+    {
+      buf[i] = (int16_t)((int32_t)ph >> 18);
+      ph += step;
+    }
+
+  *nsamples = n;
+  return buf;
+}
+
+/* ========================================================================== */
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* ========================================================================== */
+/*
+ * Pitch estimator cost and accuracy for the compiled precision. The error is
+ * the mean distance between the reported bin and the bin of the test signal
+ * pitch, in Hz, ignoring the first 4 frames (history not filled yet).
+ */
+static void bench_pitch(int mode, const struct c2enc_config_s *cfg, uint32_t f0)
+{
+  int16_t *in;
+  uint32_t n, i;
+  uint32_t frames = 0, voiced = 0;
+  double t, tbest = 1e9;
+  double err = 0, bin;
+  double expect = (double)cfg->fftsize * cfg->decim * f0 / 8000;
+  int run;
+
+  in = bench_signal(C2RS_OUTRATE, f0, &n);
+  if(!in)
+    {
+      return;
+    }
+
+  for(run=0; run<RUNS; run++)
+    {
+      if(c2enc_init_cfg(&ctx, cfg) != 0)
+        {
+          printf("%4u/%u: unsupported\n", cfg->fftsize, cfg->decim);
+          goto retfree;
+        }
+      c2enc_set_pitch(&ctx, mode);
+      err = 0;
+      frames = 0;
+      voiced = 0;
+      t = bench_now();
+      for(i=0; i+CODEC2_INPUTSAMPLES<=n; i+=CODEC2_INPUTSAMPLES)
+        {
+          c2enc_write(&ctx, in+i, CODEC2_INPUTSAMPLES);
+          if(ctx.frame > 4)
+            {
+              bin = ctx.info.pitchbin;
+              err += (bin > expect) ? (bin - expect) : (expect - bin);
+              voiced += ctx.info.voiced;
+              frames++;
+            }
+        }
+      t = bench_now() - t;
+      if(t < tbest) tbest = t;
+    }
+
+  printf("%s %s %4u/%u %3u Hz: %8.3f ms, %6.2f us/frame, mean error %5.1f Hz, %u/%u voiced\n",
+         mode == C2ENC_PITCH_ACF ? "ACF" : "NLP", PRECISION, cfg->fftsize, cfg->decim, f0,
+         tbest*1e3, tbest*1e6/ctx.frame, err / frames * 8000 / (cfg->fftsize * cfg->decim),
+         voiced, frames);
+
+retfree:
+  free(in);
+}
+
+/* ========================================================================== */
+/*
+ * Compare resampling in the encoder (c2enc_write_rate) against resampling to
+ * a separate 8 kHz buffer followed by c2enc_write. Input is fed in 20 ms
+ * packets.
+ */
+static void bench_resample(uint32_t rate)
+{
+  struct c2rs_s rs;
+  int16_t *in;
+  int16_t tmp[2*CODEC2_INPUTSAMPLES];
+  uint32_t n, i, used, nout;
+  uint32_t pkt = rate / 50;
+  double t, tfused = 1e9, tsep = 1e9;
+  int run;
+
+  in = bench_signal(rate, F0, &n);
+  if(!in)
+    {
+      return;
+    }
+
+  for(run=0; run<RUNS; run++)
+    {
+      c2enc_init(&ctx);
+      t = bench_now();
+      for(i=0; i+pkt<=n; i+=pkt)
+        {
+          c2enc_write_rate(&ctx, in+i, pkt, rate);
+        }
+      t = bench_now() - t;
+      if(t < tfused) tfused = t;
+
+      c2enc_init(&ctx);
+      c2rs_init(&rs, rate);
+      t = bench_now();
+      for(i=0; i+pkt<=n; i+=pkt)
+        {
+          nout = c2rs_process(&rs, in+i, pkt, &used, tmp, sizeof(tmp)/sizeof(tmp[0]));
+          c2enc_write(&ctx, tmp, nout);
+        }
+      t = bench_now() - t;
+      if(t < tsep) tsep = t;
+    }
+
+  printf("%5u Hz: write_rate %8.3f ms, resample+write %8.3f ms (%u frames)\n",
+          rate, tfused*1e3, tsep*1e3, ctx.frame);
+
+  free(in);
+}
+
+/* ========================================================================== */
+/*
+ * Segment-parallel encoding of one 8 kHz recording, compared to serial
+ * encoding. Counts the frames that differ from the serial result.
+ */
+static void bench_parallel(int nthreads)
+{
+  int16_t *in;
+  struct c2enc_frameinfo_s *ref, *info;
+  void *work;
+  uint32_t n, nframes, i, diff = 0;
+  double t, tser = 1e9, tpar = 1e9;
+  int run;
+
+  in = bench_signal(C2RS_OUTRATE, F0, &n);
+  nframes = n / CODEC2_INPUTSAMPLES;
+  ref  = malloc(nframes * sizeof(struct c2enc_frameinfo_s));
+  info = malloc(nframes * sizeof(struct c2enc_frameinfo_s));
+  work = malloc(c2enc_parallel_size(nthreads));
+  if(!in || !ref || !info || !work)
+    {
+      goto retfree;
+    }
+
+  for(run=0; run<RUNS; run++)
+    {
+      t = bench_now();
+      c2enc_encode_parallel(in, nframes, ref, NULL, 1, 0, work);
+      t = bench_now() - t;
+      if(t < tser) tser = t;
+
+      t = bench_now();
+      c2enc_encode_parallel(in, nframes, info, NULL, nthreads, C2ENC_PAR_WARMUP, work);
+      t = bench_now() - t;
+      if(t < tpar) tpar = t;
+    }
+
+  for(i=0; i<nframes; i++)
+    {
+      diff += (memcmp(&info[i], &ref[i], sizeof(struct c2enc_frameinfo_s)) != 0);
+    }
+
+  printf("%2d threads: serial %8.3f ms, parallel %8.3f ms, %u/%u frames differ\n",
+         nthreads, tser*1e3, tpar*1e3, diff, nframes);
+
+retfree:
+  free(work);
+  free(info);
+  free(ref);
+  free(in);
+}
+
+/* ========================================================================== */
+/*
+ * Container of one 8 kHz recording with blocks of interval frames, read back
+ * then with corrupted footers that c2s_reader_open must reject. interval
+ * must leave the last block partial.
+ */
+#define STREAM_CASES 6
+
+static void bench_stream(uint32_t interval)
+{
+  struct c2s_writer_s w;
+  struct c2s_reader_s r;
+  struct c2s_footer_s foot;
+  int16_t *in;
+  uint8_t *buf = NULL, *bad = NULL;
+  uint64_t size, len, max;
+  uint32_t n, nframes, done, used, i, rejected = 0;
+
+  in = bench_signal(C2RS_OUTRATE, F0, &n);
+  nframes = n / CODEC2_INPUTSAMPLES;
+  max = sizeof(struct c2s_header_s) + sizeof(struct c2s_footer_s) +
+        (nframes / interval + 1) * (sizeof(struct c2s_sync_s) + 8 + sizeof(uint64_t)) +
+        (uint64_t)nframes * sizeof(struct c2enc_frameinfo_s);
+  buf = malloc(max);
+  bad = malloc(max);
+  if(!in || !buf || !bad)
+    {
+      goto retfree;
+    }
+
+  c2enc_init(&ctx);
+  size = c2s_writer_init(&w, &ctx, interval, buf, max);
+  for(done = 0; done < n; done += used)
+    {
+      len = c2s_encode(&w, &ctx, in + done, n - done, &used, buf + size, max - size);
+      if(len == 0 && used == 0)
+        {
+          goto retfree;
+        }
+      size += len;
+    }
+
+  while((len = c2s_finish(&w, buf + size, max - size)) > 0)
+    {
+      size += len;
+    }
+
+  if(c2s_reader_open(&r, buf, size) != 0)
+    {
+      printf("stream %u frames per block: cannot read back\n", interval);
+      goto retfree;
+    }
+
+  for(i=0; i<STREAM_CASES; i++)
+    {
+      memcpy(bad, buf, size);
+      memcpy(&foot, buf + size - sizeof(foot), sizeof(foot));
+      len = size;
+      switch(i)
+        {
+          case 0: /* truncated in the footer */
+            len = size - 1;
+            break;
+          case 1: /* truncated in the index */
+            len = size - sizeof(uint64_t);
+            break;
+          case 2: /* index offset and size wrapping around to the file size */
+            foot.nsync += foot.index / sizeof(uint64_t) + 1;
+            foot.index -= (foot.index / sizeof(uint64_t) + 1) * sizeof(uint64_t);
+            break;
+          case 3: /* index larger than the file */
+            foot.nsync = UINT32_MAX;
+            break;
+          case 4: /* more frames than the blocks hold */
+            foot.nframes = foot.nsync * interval;
+            break;
+          case 5: /* index past the end of the file */
+            foot.index = size;
+            break;
+        }
+      memcpy(bad + len - sizeof(foot), &foot, sizeof(foot));
+      rejected += (c2s_reader_open(&r, bad, len) != 0);
+    }
+
+  printf("stream %u frames per block: %llu bytes, %u/%d corrupted footers rejected\n",
+         interval, (unsigned long long)size, rejected, STREAM_CASES);
+
+retfree:
+  free(bad);
+  free(buf);
+  free(in);
+}
+
+/* ========================================================================== */
+/*
+ * Replay of PROMPTS different 2 s prompts in random order, encoded directly
+ * and through a cache of nslots slots. Counts the plays whose results differ
+ * from the direct encoding.
+ */
+#define PROMPTS 8
+#define PLAYS   400
+
+static void bench_cache(uint32_t nslots)
+{
+  static struct c2enc_frameinfo_s ref[PROMPTS][2*100];
+  static struct c2enc_frameinfo_s out[2*100]; /* 2 s, 100 frames per second */
+  struct c2cache_s cache;
+  struct c2cache_stats_s st;
+  int16_t *in[PROMPTS] = { NULL };
+  uint64_t size;
+  uint8_t *mem;
+  uint32_t n, i, p, used, seed, diff = 0;
+  double t, tdirect, tcache;
+
+  size = sizeof(struct c2cache_hdr_s) + 16 + nslots * (2 * sizeof(uint32_t) +
+         sizeof(struct c2cache_slot_s) + sizeof(out));
+  mem  = malloc(size);
+  if(!mem || c2cache_open(&cache, mem, size, sizeof(out)/sizeof(out[0])) < 0)
+    {
+      goto retfree;
+    }
+
+  for(p=0; p<PROMPTS; p++)
+    {
+      in[p] = bench_signal(C2RS_OUTRATE, 100 + 20*p, &n);
+      if(!in[p])
+        {
+          goto retfree;
+        }
+    }
+  n = 2 * C2RS_OUTRATE;
+
+  t = bench_now();
+  for(i=0, seed=1; i<PLAYS; i++)
+    {
+      seed = seed * 1664525 + 1013904223;
+      p = (seed >> 16) % PROMPTS;
+      c2enc_init(&ctx);
+      c2enc_encode(&ctx, in[p], n, &used, ref[p], sizeof(out)/sizeof(out[0]));
+    }
+  tdirect = bench_now() - t;
+
+  t = bench_now();
+  for(i=0, seed=1; i<PLAYS; i++)
+    {
+      seed = seed * 1664525 + 1013904223;
+      p = (seed >> 16) % PROMPTS;
+      c2enc_init(&ctx);
+      c2cache_encode(&cache, &ctx, in[p], n, out, sizeof(out)/sizeof(out[0]));
+      diff += (memcmp(out, ref[p], sizeof(out)) != 0);
+    }
+  tcache = bench_now() - t;
+
+  c2cache_stats(&cache, &st);
+  printf("cache %u slots, %d prompts: direct %8.3f ms, cached %8.3f ms, "
+         "%llu hits, %llu misses, %llu evictions, %u/%u plays differ\n",
+         nslots, PROMPTS, tdirect*1e3, tcache*1e3, (unsigned long long)st.hits,
+         (unsigned long long)st.misses, (unsigned long long)st.evictions, diff, PLAYS);
+
+retfree:
+  for(p=0; p<PROMPTS; p++)
+    {
+      free(in[p]);
+    }
+  free(mem);
+}
+
+/* ========================================================================== */
+int main(int argc, char **argv)
+{
+  static const struct c2enc_config_s defcfg = C2ENC_CONFIG_DEFAULT;
+  uint32_t i;
+
+  printf("%d s of input, best of %d runs\n", SECONDS, RUNS);
+
+  printf("context %lu bytes\n", (unsigned long)sizeof(struct c2enc_context_s));
+  for(i=0; i<sizeof(pitches)/sizeof(pitches[0]); i++)
+    {
+      bench_pitch(C2ENC_PITCH_NLP, &defcfg, pitches[i]);
+      bench_pitch(C2ENC_PITCH_ACF, &defcfg, pitches[i]);
+    }
+
+  for(i=0; i<sizeof(configs)/sizeof(configs[0]); i++)
+    {
+      bench_pitch(C2ENC_PITCH_NLP, &configs[i], F0);
+      bench_pitch(C2ENC_PITCH_ACF, &configs[i], F0);
+    }
+
+  bench_resample(16000);
+  bench_resample(48000);
+
+  bench_parallel(2);
+  bench_parallel(4);
+
+  bench_stream(64);
+
+  bench_cache(PROMPTS);
+  bench_cache(PROMPTS - 2);
+
+  return 0;
+}
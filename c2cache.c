@@ -0,0 +1,444 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* c2cache - cache of encoded clips, see c2cache.h */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "c2fxp.h"
+#include "c2cache.h"
+
+#define C2CACHE_FRAMESIZE sizeof(struct c2enc_frameinfo_s)
+
+/* Hash multipliers (64-bit golden ratio and murmur3 finalizer constants) */
+#define C2CACHE_M1 0x9E3779B97F4A7C15ULL
+#define C2CACHE_M2 0xC2B2AE3D27D4EB4FULL
+#define C2CACHE_M3 0x165667B19E3779F9ULL
+
+#define C2CACHE_SLOT(c,i) ((struct c2cache_slot_s *)((c)->slots + (uint64_t)(i) * (c)->slotsize))
+#define C2CACHE_FRAMES(s) ((struct c2enc_frameinfo_s *)((s) + 1))
+
+/* ========================================================================== */
+/* Hash finalizer (murmur3) */
+static inline uint64_t c2cache_fmix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* ========================================================================== */
+/*
+ * Check the links of a cache found in memory: indices in range, the LRU list
+ * and the bucket chains without loops, each used slot once in both.
+ * Returns 0 if the cache can be used, -1 if it must be formatted again.
+ */
+static int c2cache_check(const struct c2cache_s *cache)
+{
+  const struct c2cache_hdr_s *hdr = cache->hdr;
+  const struct c2cache_slot_s *slot;
+  uint32_t used = hdr->stats.used;
+  uint32_t i, b, n, prev;
+
+  if(hdr->dirty || used > hdr->nslots || hdr->stats.nslots != hdr->nslots)
+    {
+      return -1;
+    }
+
+  /* LRU list, from head to tail: a slot seen twice breaks the back links */
+
+  n    = 0;
+  prev = C2CACHE_NIL;
+  for(i = hdr->lruhead; i != C2CACHE_NIL; i = slot->next)
+    {
+      if(i >= used || n++ == used)
+        {
+          return -1;
+        }
+      slot = C2CACHE_SLOT(cache, i);
+      if(slot->prev != prev || slot->nframes != slot->nsamples / CODEC2_INPUTSAMPLES ||
+         slot->nframes > hdr->slotframes)
+        {
+          return -1;
+        }
+      prev = i;
+    }
+
+  if(n != used || hdr->lrutail != prev)
+    {
+      return -1;
+    }
+
+  /* Bucket chains, each slot in the bucket of its key */
+
+  n = 0;
+  for(b=0; b<hdr->nbuckets; b++)
+    {
+      for(i = cache->buckets[b]; i != C2CACHE_NIL; i = slot->hnext)
+        {
+          if(i >= used || n++ == used)
+            {
+              return -1;
+            }
+          slot = C2CACHE_SLOT(cache, i);
+          if((slot->key & (hdr->nbuckets - 1)) != b)
+            {
+              return -1;
+            }
+        }
+    }
+
+  return (n == used) ? 0 : -1;
+}
+
+/* ========================================================================== */
+/*
+ * Mark the cache as being updated, or done. A cache left marked by a process
+ * that died is formatted again on open. The compiler must not move the link
+ * updates across the mark.
+ */
+static inline void c2cache_dirty(struct c2cache_s *cache, uint32_t dirty)
+{
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  cache->hdr->dirty = dirty;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+/* ========================================================================== */
+/*
+ * Use size bytes at mem as a cache of clips up to slotframes frames long.
+ * Memory that already holds a cache of the same geometry is used as is, this
+ * is how a mapped file is reopened. It is formatted again if its links do
+ * not check out, or if a process died while updating it. mem must be 8-byte
+ * aligned.
+ * Returns 1 if an existing cache was found, 0 if the memory was formatted,
+ * -1 if it is too small for one slot.
+ */
+int c2cache_open(struct c2cache_s *cache, void *mem, uint64_t size, uint32_t slotframes)
+{
+  struct c2cache_hdr_s *hdr = mem;
+  uint64_t slotsize = sizeof(struct c2cache_slot_s) + (uint64_t)slotframes * C2CACHE_FRAMESIZE;
+  uint64_t nslots;
+  uint32_t nbuckets;
+  uint32_t i;
+
+  if(slotframes == 0 || size < sizeof(*hdr) + sizeof(uint64_t))
+    {
+      return -1;
+    }
+
+  /* Up to two buckets per slot, plus alignment of the slots */
+
+  nslots = (size - sizeof(*hdr) - sizeof(uint64_t)) / (slotsize + 2*sizeof(uint32_t));
+  if(nslots == 0)
+    {
+      return -1;
+    }
+  if(nslots >= C2CACHE_NIL / 2)
+    {
+      nslots = C2CACHE_NIL / 2;
+    }
+
+  nbuckets = 1;
+  while(nbuckets < nslots)
+    {
+      nbuckets <<= 1;
+    }
+
+  cache->hdr      = hdr;
+  cache->buckets  = (uint32_t *)(hdr + 1);
+  cache->slots    = (uint8_t *)mem + ((sizeof(*hdr) + nbuckets * sizeof(uint32_t) + 7) & ~7UL);
+  cache->slotsize = slotsize;
+
+  if(hdr->magic == C2CACHE_MAGIC && hdr->version == C2CACHE_VERSION &&
+     hdr->nlpbits == NLPBITS && hdr->slotframes == slotframes &&
+     hdr->nslots == nslots && hdr->nbuckets == nbuckets && hdr->size == size &&
+     c2cache_check(cache) == 0)
+    {
+      return 1;
+    }
+
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->version      = C2CACHE_VERSION;
+  hdr->nlpbits      = NLPBITS;
+  hdr->slotframes   = slotframes;
+  hdr->nslots       = nslots;
+  hdr->nbuckets     = nbuckets;
+  hdr->lruhead      = C2CACHE_NIL;
+  hdr->lrutail      = C2CACHE_NIL;
+  hdr->size         = size;
+  hdr->stats.nslots = nslots;
+
+  for(i=0; i<nbuckets; i++)
+    {
+      cache->buckets[i] = C2CACHE_NIL;
+    }
+
+  /* Valid once formatted */
+
+  hdr->magic = C2CACHE_MAGIC;
+  return 0;
+}
+
+/* ========================================================================== */
+/*
+ * 64-bit hash of a clip and of the configuration of the encoder it is
+ * encoded with. Samples are mixed four at a time. check receives a second,
+ * independent hash of the same data, compared on lookup so that a key
+ * collision cannot return the results of another clip.
+ */
+static uint64_t c2cache_digest(const int16_t *samples, uint32_t nsamples,
+                               const struct c2enc_context_s *ctx, uint64_t *check)
+{
+  uint64_t h, c, k;
+  uint32_t i;
+
+  h  = (uint64_t)ctx->fftsize | (uint64_t)ctx->decim << 16 |
+       (uint64_t)ctx->pitchmode << 24 | (uint64_t)NLPBITS << 32;
+  c  = h ^ nsamples * C2CACHE_M3;
+  h ^= nsamples * C2CACHE_M1;
+
+  for(i=0; i+4<=nsamples; i+=4)
+    {
+      memcpy(&k, samples + i, sizeof(k));
+      h ^= k * C2CACHE_M2;
+      h  = ((h << 31) | (h >> 33)) * C2CACHE_M1;
+      c += k * C2CACHE_M1;
+      c  = ((c << 27) | (c >> 37)) * C2CACHE_M3;
+    }
+
+  for(; i<nsamples; i++)
+    {
+      k  = (uint16_t)samples[i];
+      h ^= k * C2CACHE_M2;
+      h  = ((h << 31) | (h >> 33)) * C2CACHE_M1;
+      c += k * C2CACHE_M1;
+      c  = ((c << 27) | (c >> 37)) * C2CACHE_M3;
+    }
+
+  *check = c2cache_fmix(c);
+  return c2cache_fmix(h);
+}
+
+/* ========================================================================== */
+/*
+ * 64-bit hash of a clip and of the configuration of the encoder it is
+ * encoded with, the key of the clip in the cache.
+ */
+uint64_t c2cache_hash(const int16_t *samples, uint32_t nsamples, const struct c2enc_context_s *ctx)
+{
+  uint64_t check;
+
+  return c2cache_digest(samples, nsamples, ctx, &check);
+}
+
+/* ========================================================================== */
+/* Remove a slot from the LRU list */
+static void c2cache_unlink(struct c2cache_s *cache, uint32_t i)
+{
+  struct c2cache_slot_s *slot = C2CACHE_SLOT(cache, i);
+
+  if(slot->prev != C2CACHE_NIL)
+    {
+      C2CACHE_SLOT(cache, slot->prev)->next = slot->next;
+    }
+  else
+    {
+      cache->hdr->lruhead = slot->next;
+    }
+
+  if(slot->next != C2CACHE_NIL)
+    {
+      C2CACHE_SLOT(cache, slot->next)->prev = slot->prev;
+    }
+  else
+    {
+      cache->hdr->lrutail = slot->prev;
+    }
+}
+
+/* ========================================================================== */
+/* Insert a slot at the head of the LRU list */
+static void c2cache_push(struct c2cache_s *cache, uint32_t i)
+{
+  struct c2cache_slot_s *slot = C2CACHE_SLOT(cache, i);
+
+  slot->prev = C2CACHE_NIL;
+  slot->next = cache->hdr->lruhead;
+  if(slot->next != C2CACHE_NIL)
+    {
+      C2CACHE_SLOT(cache, slot->next)->prev = i;
+    }
+  else
+    {
+      cache->hdr->lrutail = i;
+    }
+  cache->hdr->lruhead = i;
+}
+
+/* ========================================================================== */
+/* Get a slot for a new clip: a free one, or the least recently used one */
+static uint32_t c2cache_alloc(struct c2cache_s *cache)
+{
+  struct c2cache_hdr_s *hdr = cache->hdr;
+  struct c2cache_slot_s *slot;
+  uint32_t *link;
+  uint32_t i;
+
+  if(hdr->stats.used < hdr->nslots)
+    {
+      return hdr->stats.used++;
+    }
+
+  i    = hdr->lrutail;
+  slot = C2CACHE_SLOT(cache, i);
+  c2cache_unlink(cache, i);
+
+  for(link = &cache->buckets[slot->key & (hdr->nbuckets - 1)]; *link != i;
+      link = &C2CACHE_SLOT(cache, *link)->hnext)
+    {
+    }
+  *link = slot->hnext;
+
+  hdr->stats.evictions++;
+  return i;
+}
+
+/* ========================================================================== */
+/*
+ * Encode a clip, if samples is not NULL, from a fresh encoder with the
+ * configuration of ctx, then leave ctx as a fresh encoder: hits and misses
+ * end in the same state. The results only go to out: the ring and callback of
+ * ctx are not fed, they and its output pointer are given back to it.
+ */
+static uint32_t c2cache_fill(struct c2enc_context_s *ctx, const int16_t *samples, uint32_t nsamples,
+                             struct c2enc_frameinfo_s *out, uint32_t maxout)
+{
+  struct c2enc_config_s cfg;
+  struct c2enc_ring_s *ring = ctx->ring;
+  c2enc_callback_t callback = ctx->callback;
+  void *cbarg = ctx->cbarg;
+  struct c2enc_frameinfo_s *ctxout = ctx->out;
+  uint32_t used, n = 0;
+
+  cfg.fftsize   = ctx->fftsize;
+  cfg.decim     = ctx->decim;
+  cfg.pitchmode = ctx->pitchmode;
+  c2enc_init_cfg(ctx, &cfg);
+
+  if(samples)
+    {
+      n = c2enc_encode(ctx, samples, nsamples, &used, out, maxout);
+      c2enc_init_cfg(ctx, &cfg);
+    }
+
+  ctx->ring     = ring;
+  ctx->callback = callback;
+  ctx->cbarg    = cbarg;
+  ctx->out      = ctxout;
+  return n;
+}
+
+/* ========================================================================== */
+/*
+ * Encode a clip of 8 kHz samples into out, through the cache. The results are
+ * those of a fresh encoder with the configuration and pitch estimator of ctx:
+ * one per whole frame, numbered from 0. ctx is only encoded with on a miss,
+ * and is left as a fresh encoder of its configuration in all cases. Its ring
+ * and callback are kept, results of the cache are not passed to them.
+ * Returns the number of results stored in out, -1 if maxout is too small.
+ */
+int32_t c2cache_encode(struct c2cache_s *cache, struct c2enc_context_s *ctx,
+                       const int16_t *samples, uint32_t nsamples,
+                       struct c2enc_frameinfo_s *out, uint32_t maxout)
+{
+  struct c2cache_hdr_s *hdr = cache->hdr;
+  struct c2cache_slot_s *slot;
+  uint32_t nframes = nsamples / CODEC2_INPUTSAMPLES;
+  uint32_t *bucket;
+  uint64_t key, check;
+  uint32_t i;
+
+  if(nframes > maxout)
+    {
+      return -1;
+    }
+
+  if(nframes > hdr->slotframes)
+    {
+      hdr->stats.bypass++;
+      return c2cache_fill(ctx, samples, nsamples, out, maxout);
+    }
+
+  key    = c2cache_digest(samples, nsamples, ctx, &check);
+  bucket = &cache->buckets[key & (hdr->nbuckets - 1)];
+
+  for(i = *bucket; i != C2CACHE_NIL; i = slot->hnext)
+    {
+      slot = C2CACHE_SLOT(cache, i);
+      if(slot->key == key && slot->check == check && slot->nsamples == nsamples &&
+         slot->fftsize == ctx->fftsize && slot->decim == ctx->decim &&
+         slot->pitchmode == ctx->pitchmode)
+        {
+          hdr->stats.hits++;
+          c2cache_dirty(cache, 1);
+          c2cache_unlink(cache, i);
+          c2cache_push(cache, i);
+          c2cache_dirty(cache, 0);
+          memcpy(out, C2CACHE_FRAMES(slot), nframes * C2CACHE_FRAMESIZE);
+          c2cache_fill(ctx, NULL, 0, NULL, 0);
+          return nframes;
+        }
+    }
+
+  /* Miss: encode and keep the results */
+
+  hdr->stats.misses++;
+  nframes = c2cache_fill(ctx, samples, nsamples, out, maxout);
+
+  c2cache_dirty(cache, 1);
+  i    = c2cache_alloc(cache);
+  slot = C2CACHE_SLOT(cache, i);
+  slot->key       = key;
+  slot->check     = check;
+  slot->nsamples  = nsamples;
+  slot->nframes   = nframes;
+  slot->fftsize   = ctx->fftsize;
+  slot->decim     = ctx->decim;
+  slot->pitchmode = ctx->pitchmode;
+  memcpy(C2CACHE_FRAMES(slot), out, nframes * C2CACHE_FRAMESIZE);
+
+  slot->hnext = *bucket;
+  *bucket     = i;
+  c2cache_push(cache, i);
+  c2cache_dirty(cache, 0);
+
+  return nframes;
+}
+
+/* ========================================================================== */
+/*
+ * Cache statistics, since the cache memory was formatted.
+ */
+void c2cache_stats(const struct c2cache_s *cache, struct c2cache_stats_s *stats)
+{
+  *stats = cache->hdr->stats;
+}
@@ -0,0 +1,112 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* c2cache - cache of encoded clips, keyed by a hash of their content */
+
+#ifndef __C2CACHE__H__
+#define __C2CACHE__H__
+
+#include <stdint.h>
+#include "c2fxp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A clip is a complete 8 kHz recording encoded from a fresh encoder, like a
+ * prompt that is played again and again. Its frame results are stored under
+ * a 64-bit hash of its samples, its length and the encoder configuration, so
+ * that encoding it again is a lookup and a copy.
+ *
+ * The cache lives in caller memory: a buffer, or a file mapped with
+ * MAP_SHARED for a store that survives restarts. It holds fixed-size slots
+ * of slotframes results, evicted in least recently used order. Links are
+ * slot indices, the memory can be mapped at any address. Clips longer than a
+ * slot are encoded without the cache.
+ *
+ * A cache must not be used by several threads or processes at once: there is
+ * no locking inside, processes sharing a cache file hold flock(LOCK_EX) on it
+ * while it is open. A process that dies in the middle of an update leaves the
+ * cache marked dirty, and it is formatted again on the next open. */
+
+#define C2CACHE_MAGIC   0x48433243UL /* "C2CH" */
+#define C2CACHE_VERSION 2
+#define C2CACHE_NIL     0xFFFFFFFFUL
+
+struct c2cache_stats_s
+{
+  uint64_t hits;
+  uint64_t misses;    /* encoded and stored */
+  uint64_t evictions; /* slots reused for another clip */
+  uint64_t bypass;    /* encoded without the cache, too long for a slot */
+  uint32_t used;      /* slots in use */
+  uint32_t nslots;
+};
+
+/* Layout of the cache memory: header, buckets, slots */
+
+struct c2cache_hdr_s
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nlpbits;
+  uint32_t slotframes;
+  uint32_t nslots;
+  uint32_t nbuckets;    /* power of two */
+  uint32_t lruhead;     /* most recently used slot */
+  uint32_t lrutail;     /* least recently used slot, next evicted */
+  uint32_t dirty;       /* links being updated */
+  uint32_t reserved;
+  uint64_t size;        /* bytes of cache memory */
+  struct c2cache_stats_s stats;
+};
+
+struct c2cache_slot_s
+{
+  uint64_t key;
+  uint64_t check;     /* second hash of the clip */
+  uint32_t nsamples;
+  uint32_t nframes;
+  uint16_t fftsize;   /* configuration, checked on lookup */
+  uint8_t  decim;
+  uint8_t  pitchmode;
+  uint32_t hnext;     /* next slot in the bucket */
+  uint32_t prev;      /* LRU list */
+  uint32_t next;
+  /* followed by slotframes struct c2enc_frameinfo_s */
+};
+
+struct c2cache_s
+{
+  struct c2cache_hdr_s *hdr;
+  uint32_t *buckets;
+  uint8_t *slots;
+  uint64_t slotsize;
+};
+
+C2FXP_API int c2cache_open(struct c2cache_s *cache, void *mem, uint64_t size, uint32_t slotframes);
+C2FXP_API uint64_t c2cache_hash(const int16_t *samples, uint32_t nsamples, const struct c2enc_context_s *ctx);
+C2FXP_API int32_t c2cache_encode(struct c2cache_s *cache, struct c2enc_context_s *ctx,
+                                 const int16_t *samples, uint32_t nsamples,
+                                 struct c2enc_frameinfo_s *out, uint32_t maxout);
+C2FXP_API void c2cache_stats(const struct c2cache_s *cache, struct c2cache_stats_s *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C2CACHE__H__ */
@@ -19,7 +19,6 @@
 /* codec2 decoder implementation */
 
 #include <stdint.h>
-#include <stdio.h>
 
 #include "c2fxp.h"
 
@@ -30,6 +29,6 @@ int c2dec_init(struct c2dec_context_s *ctx)
 
 int c2dec_write(struct c2dec_context_s *ctx, uint8_t *buf, uint32_t nsamples)
 {
-  printf("c2dec process, len=%d\n",nsamples);
+  return 0;
 }
 
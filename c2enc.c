@@ -21,12 +21,12 @@
 #define FRAME 88
 
 #include <stdint.h>
-#include <stdio.h>
 #include <string.h>
 
 #include "fxpmath.h"
 #include "fft.h"
 #include "c2fxp.h"
+#include "opcount.h"
 
 /* notch filter parameter, 0.95*/
 #define COEFF DTOQ31(0.95)
@@ -59,29 +59,263 @@ static const q31_t nlpfirq31[48] =
     -908159,  -1992196,  -2364024,  -2323174,
 };
 
-#define NLPFIRCOUNT (sizeof(nlpfir)/sizeof(nlpfir[0]))
+#define NLPFIRCOUNT ((uint32_t)(sizeof(nlpfir)/sizeof(nlpfir[0])))
 
-/* 64-bins Hanning window, values of:
+/* Pitch search range, Hz */
+#define F_MIN_S 50
+#define F_MAX_S 400
+
+/* A frame is marked voiced when its NLP peak is at least this many times
+ * the mean of the positive bins of the pitch search range. This is a crude
+ * indication only, not the codec2 voicing decision. */
+#define VOICING_RATIO 4
+
+/* Autocorrelation pitch search. The decimated rate is 8000/decim Hz, the
+ * lags cover F_MAX_S to F_MIN_S. Once a lag correlates at least ACF_EARLY
+ * (Q15) the search stops on the first lag that correlates less. A frame is
+ * marked voiced when the best correlation is at least ACF_VOICED (Q15). */
+#define ACF_EARLY   26214 /* 0.8 */
+#define ACF_VOICED  16384 /* 0.5 */
+#define ACF_RHOMAX  (sizeof(((struct c2enc_context_s *)0)->acfrho) / sizeof(int32_t))
+
+/* Ring indices are shared between the encoder and the consumer thread */
+#define RING_LOAD(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define RING_STORE(p,v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+/* Operations on NLP samples, see nlp_t */
+
+#ifdef C2FXP_NLP_Q31
+#define nlp_mul(a,b)  q31_mul(a,b)
+#define nlp_abs(v)    q31_abs(v)
+#define nlp_scale(v,s) q31_sat_nc((int64_t)(v) * (s)) /* pinned, seen by the overflow test */
+#define nlp_fft       q31_fft
+#define Q15TONLP(v)   Q15TOQ31(v)
+#define NLPTOQ31(v)   (v)
+#define Q31TONLP(v)   (v)
+#define NLPTOACF(v)   ((v) >> 16)
+#else
+#define nlp_mul(a,b)  q15_mul(a,b)
+#define nlp_abs(v)    q15_abs(v)
+#define nlp_scale(v,s) ((nlp_t)((v) * (s)))
+#define nlp_fft       q15_fft
+#define Q15TONLP(v)   (v)
+#define NLPTOQ31(v)   Q15TOQ31(v)
+#define Q31TONLP(v)   Q31TOQ15(v)
+#define NLPTOACF(v)   ((int32_t)(v))
+#endif
+
+/* ========================================================================== */
+/*
+ * Generate the Hanning window of the decimated samples, values of:
  * nlp->w[i] = 0.5 - 0.5*cosf(2*PI*i/(m/DEC-1));
- * Stored value is round(32768 * hanning). */
-static const int16_t nlpwin[64] =
+ * Stored value is round(32768 * hanning), this gives the same values as the
+ * 64-bins table of the reference implementation. Not counted, this is init
+ * and not part of the per-frame profile.
+ */
+static void c2enc_window(q15_t *win, uint32_t len)
 {
-      0 ,    81 ,   325 ,  728 , 1287  , 1995 ,  2847 ,  3833 ,
-   4944 ,  6169 ,  7495 , 8909 ,10398  ,11947 , 13539 , 15160 ,
-  16792 , 18421 , 20030 ,21602 ,23123  ,24576 , 25948 , 27225 ,
-  28394 , 29444 , 30364 ,31145 ,31780  ,32261 , 32585 , 32748 ,
-  32748 , 32585 , 32261 ,31780 ,31145  ,30364 , 29444 , 28394 ,
-  27225 , 25948 , 24576 ,23123 ,21602  ,20030 , 18421 , 16792 ,
-  15160 , 13539 , 11947 ,10398 , 8909  , 7495 ,  6169 ,  4944 ,
-   3833 ,  2847 ,  1995 , 1287 ,  728  ,  325 ,    81 ,     0
-};
+  uint32_t i;
+  q31_t vcos, vsin;
+  int32_t w;
+
+  for(i=0; i<len; i++)
+    {
+      q31_sincos_nc((fxpangle_t)(((uint64_t)i << 32) / (len - 1)), &vcos, &vsin);
+      w = (int32_t)(((int64_t)0x80000000LL - vcos + (1 << 16)) >> 17);
+      win[i] = (w > 32767) ? 32767 : w;
+    }
+}
+
+/* ========================================================================== */
+/*
+ * NLP pitch estimator: the decimated samples are zero padded to
+ * the FFT size and the pitch is the highest FFT bin in the search range.
+ */
+static void c2enc_nlp_fft(struct c2enc_context_s *ctx, uint32_t scale)
+{
+  int i;
+  nlp_t gmax;
+  int gmax_bin;
+  int64_t sum = 0;
+
+  /* Padding before FFT */
+
+  FXP_COUNT(FXP_OP_MEM, 2*(ctx->fftsize-ctx->winlen));
+  for(i=ctx->winlen; i<ctx->fftsize; i++)
+    {
+      ctx->nlpfftr[i] = 0;
+      ctx->nlpffti[i] = 0;
+    }
+
+  /* Execute FFT of filtered squared samples */
+
+  FXP_STAGE(C2PROF_FFT);
+  nlp_fft(ctx->nlpfftr, ctx->nlpffti, ctx->fftsize);
+
+  /* Find global peak */
+
+  FXP_STAGE(C2PROF_PEAK);
+  FXP_COUNT(FXP_OP_ADD15, 2*(ctx->binmax - ctx->binmin + 1)); /* compares, sum */
+
+  gmax = 0;
+  gmax_bin = ctx->binmin;
+
+  for(i=ctx->binmin; i<=ctx->binmax; i++)
+    {
+      if (ctx->nlpfftr[i] > gmax)
+        {
+          gmax = ctx->nlpfftr[i];
+          gmax_bin = i;
+        }
+      if (ctx->nlpfftr[i] > 0)
+        {
+          sum += ctx->nlpfftr[i];
+        }
+    }
+
+  ctx->info.frame    = ctx->frame;
+  ctx->info.pitchbin = gmax_bin;
+  ctx->info.scale    = scale;
+  ctx->info.peak     = NLPTOQ31(gmax);
+  ctx->info.voiced   = (int64_t)gmax * (ctx->binmax - ctx->binmin + 1) >=
+                       sum * VOICING_RATIO && gmax > 0;
+  ctx->info.decim    = ctx->decim;
+  ctx->info.fftsize  = ctx->fftsize;
+}
+
+/* ========================================================================== */
+/*
+ * Autocorrelation pitch estimator. For each lag k the correlation of the
+ * decimated samples with themselves delayed by k is normalized by the energy
+ * of the two overlapping parts:
+ *   rho(k) = sum x[n]x[n+k] / sqrt(sum x[n]^2 * sum x[n+k]^2)
+ * The energies are updated incrementally from one lag to the next.
+ * The short lags first follow the main lobe of rho(0): they are not candidates
+ * until rho has started to rise again. Lags with a negative correlation are
+ * not normalized. The best lag is refined by parabolic interpolation and
+ * converted to the FFT bin units of the NLP estimator.
+ */
+static void c2enc_acf(struct c2enc_context_s *ctx, uint32_t scale)
+{
+  nlp_t *x = ctx->nlpfftr; /* converted in place */
+  int32_t *rho = ctx->acfrho;
+  int64_t r, e0, e1;
+  uint64_t den;
+  int32_t prev;
+  int falling = 1;
+  int best = 0;
+  int32_t a, b, c, d;
+  int32_t lagq8;
+  int i, k;
+
+  FXP_STAGE(C2PROF_ACF);
+
+  e0 = 0;
+  for(i=0; i<ctx->winlen; i++)
+    {
+      x[i] = NLPTOACF(x[i]);
+      e0  += (int64_t)x[i] * x[i];
+    }
+  FXP_COUNT(FXP_OP_MAC, ctx->winlen);
+
+  /* Energy of x[0..N-1-k] and x[k..N-1] for k = ctx->lagmin-1 */
+
+  e1 = e0;
+  for(k=1; k<ctx->lagmin; k++)
+    {
+      e0 -= (int64_t)x[ctx->winlen-k] * x[ctx->winlen-k];
+      e1 -= (int64_t)x[k-1] * x[k-1];
+    }
+
+  prev = 32767;
+  for(k=ctx->lagmin; k<=ctx->lagmax+1 && k<ctx->winlen; k++)
+    {
+      e0 -= (int64_t)x[ctx->winlen-k] * x[ctx->winlen-k];
+      e1 -= (int64_t)x[k-1] * x[k-1];
+
+      r = 0;
+      for(i=0; i<ctx->winlen-k; i++)
+        {
+          r += (int64_t)x[i] * x[i+k];
+        }
+      FXP_COUNT(FXP_OP_MAC, ctx->winlen-k+2);
+
+      den = (uint64_t)fxp_isqrt64(e0) * fxp_isqrt64(e1);
+      if(r <= 0 || den == 0)
+        {
+          rho[k] = 0;
+        }
+      else
+        {
+          r = (r << 15) / den;
+          rho[k] = r > 32767 ? 32767 : (int32_t)r; /* rounded down roots */
+        }
+
+      if(k > ctx->lagmax)
+        {
+          break; /* only needed for interpolation */
+        }
+
+      if(falling)
+        {
+          falling = rho[k] <= prev;
+          prev    = rho[k];
+          if(falling)
+            {
+              continue;
+            }
+        }
+
+      if(best == 0 || rho[k] > rho[best])
+        {
+          best = k;
+        }
+      else if(rho[best] >= ACF_EARLY)
+        {
+          break; /* early exit, we are past a strong peak */
+        }
+    }
+
+  ctx->info.frame   = ctx->frame;
+  ctx->info.scale   = scale;
+  ctx->info.decim   = ctx->decim;
+  ctx->info.fftsize = ctx->fftsize;
+
+  if(best == 0)
+    {
+      /* No peak in the lag range */
+      ctx->info.pitchbin = ctx->fftsize / ctx->lagmax;
+      ctx->info.peak     = 0;
+      ctx->info.voiced   = 0;
+      return;
+    }
+
+  /* Parabolic interpolation of the peak, lag in Q8 */
+
+  lagq8 = best << 8;
+  if(best > ctx->lagmin && best < k)
+    {
+      a = rho[best-1];
+      b = rho[best];
+      c = rho[best+1];
+      d = a - 2*b + c;
+      if(d < 0)
+        {
+          lagq8 += ((a - c) * 128) / d;
+        }
+    }
+
+  ctx->info.pitchbin = (ctx->fftsize*256 + lagq8/2) / lagq8;
+  ctx->info.peak     = (q31_t)rho[best] << 16;
+  ctx->info.voiced   = rho[best] >= ACF_VOICED;
+}
 
 /* ========================================================================== */
 /*
  * Non linear pitch prediction. This algorithm extracts the fundamental
  * frequency of the speech signal. To do that a number of steps are required:
  * - preprocessing: DC notch and 600 Hz LPF (48-tap FIR)
- * - decimation by 5 (this gives 64 samples)
+ * - decimation by 5 (this gives 64 samples), see struct c2enc_config_s
  * - padding to 512 samples by appending 448 zero samples
  * - Perform DFT
  * - basic estimation,
@@ -89,39 +323,45 @@ static const int16_t nlpwin[64] =
  * - coarse then fine refinements
  * The algorithm is based on the DFT of the squared speech signal.
  */
-static void c2enc_nlp(struct c2enc_context_s *ctx)
+static void c2enc_nlp(struct c2enc_context_s *ctx, const q15_t *frame)
 {
-  int i,j;
+  int i;
+  uint32_t j;
   q31_t ntmp;
-  q15_t tmp,gmax;
-  int gmax_bin;
-  uint32_t scale = 512;
-  uint32_t acc;
+  uint32_t scale = ctx->fftsize;
+  uint64_t acc;
 
-  /* Square the last samples */
+  /* Square the new samples */
 
-  for(i=240;i<320;i++)
+  FXP_STAGE(C2PROF_SQUARE);
+
+  for(i=0;i<CODEC2_INPUTSAMPLES;i++)
     {
       /* Samples are 16-bit signed, mask the sign bit before mult */
-      ctx->nlpsq[i] = q15_mul(ctx->input[i], ctx->input[i]);
+      ctx->nlpsq[240+i] = nlp_mul(Q15TONLP(frame[i]), Q15TONLP(frame[i]));
     }
 
   /* Notch filter at DC the last samples. This is an IIR filter, it
    * requires more precision to avoid bias. */
 
+  FXP_STAGE(C2PROF_NOTCH);
+
   for(i=240; i<320; i++)
     {
-      ntmp           = q31_sub(Q15TOQ31(ctx->nlpsq[i]), ctx->nlpmemx);
+      ntmp           = q31_sub(NLPTOQ31(ctx->nlpsq[i]), ctx->nlpmemx);
       ntmp           = q31_add(ntmp, q31_mul(COEFF, ctx->nlpmemy));
-      ctx->nlpmemx  = Q15TOQ31(ctx->nlpsq[i]);
+      ctx->nlpmemx  = NLPTOQ31(ctx->nlpsq[i]);
       ctx->nlpmemy  = ntmp;
-      ctx->nlpsq[i] = Q31TOQ15(ntmp);
+      ctx->nlpsq[i] = Q31TONLP(ntmp);
     }
 
   /* Low pass FIR the last samples */
 
+  FXP_STAGE(C2PROF_FIR);
+
   for(i=240; i<320; i++)
     {
+      FXP_COUNT(FXP_OP_MEM, NLPFIRCOUNT);
       for(j=0; j<NLPFIRCOUNT-1; j++)
         {
           ctx->nlpmemfir[j] = ctx->nlpmemfir[j+1];
@@ -131,9 +371,9 @@ static void c2enc_nlp(struct c2enc_context_s *ctx)
       ntmp = 0;
       for(j=0; j<NLPFIRCOUNT; j++)
         {
-          ntmp = q31_add(ntmp, q31_mul(Q15TOQ31(ctx->nlpmemfir[j]), nlpfirq31[j]));
+          ntmp = q31_add(ntmp, q31_mul(NLPTOQ31(ctx->nlpmemfir[j]), nlpfirq31[j]));
         }
-      ctx->nlpsq[i] = Q31TOQ15(ntmp);
+      ctx->nlpsq[i] = Q31TONLP(ntmp);
     }
 
   /* Decimation, for ALL samples. This means that the result is an overlapped analysis
@@ -145,24 +385,29 @@ static void c2enc_nlp(struct c2enc_context_s *ctx)
    * but this may result in clipping. To overcome that, we multiply samples by the highest
    * possible power of two that will not result in clipping. Then, we apply FFT, and we
    * finish by multiplying the FFT coefficients enough to ensure that the total scale is 512.
+   * The same applies to the other FFT sizes.
    */
 
+  FXP_STAGE(C2PROF_WINDOW);
+
 rescale:
   acc = 0;
 
-  for(i=0; i<64; i++)
+  /* Sample and window loads, stores, imaginary part cleared on the first pass */
+  FXP_COUNT(FXP_OP_MEM, (scale == ctx->fftsize) ? 3*ctx->winlen : 2*ctx->winlen);
+  for(i=0; i<ctx->winlen; i++)
     {
-      ctx->nlpfftr[i] = q15_mul(ctx->nlpsq[i*5], nlpwin[i]) * scale;
+      ctx->nlpfftr[i] = nlp_scale(nlp_mul(ctx->nlpsq[i*ctx->decim], Q15TONLP(ctx->nlpwin[i])), scale);
 
-      acc |= q15_abs(ctx->nlpfftr[i]) * scale;
+      acc |= (uint64_t)nlp_abs(ctx->nlpfftr[i]) * scale;
 
-      if(scale != 512) continue;
+      if(scale != ctx->fftsize) continue;
       ctx->nlpffti[i] = 0; /* while we're here, zero the imaginary part (but only once)*/
     }
 
   /* detect overflow during scaling */
 
-  if(acc>>16)
+  if(acc>>(NLPBITS+1))
     {
       if(scale>1)
         {
@@ -171,40 +416,22 @@ rescale:
         }
     }
 
-  /* Padding before FFT */
+  /* Pitch estimation on the decimated samples */
 
-  for(i=64; i<CODEC2_FFTSAMPLES; i++)
+  if(ctx->pitchmode == C2ENC_PITCH_ACF)
     {
-      ctx->nlpfftr[i] = 0;
-      ctx->nlpffti[i] = 0;
+      c2enc_acf(ctx, scale);
     }
-
-  /* Execute FFT of filtered squared samples */
-
-  q15_fft(ctx->nlpfftr, ctx->nlpffti, CODEC2_FFTSAMPLES);
-
-#define F_MIN_S 50
-#define F_MAX_S 400
-
-  /* Find global peak */
-
-  gmax = 0;
-  gmax_bin = CODEC2_FFTSAMPLES*5*F_MIN_S/8000;
-
-  for(i=CODEC2_FFTSAMPLES*5*F_MIN_S/8000; i<=CODEC2_FFTSAMPLES*5*F_MAX_S/8000; i++)
+  else
     {
-      if (ctx->nlpfftr[i] > gmax)
-        {
-          gmax = ctx->nlpfftr[i];
-          gmax_bin = i;
-        }
+      c2enc_nlp_fft(ctx, scale);
     }
 
-printf("%d\n", gmax_bin);
-
   /* Post process using the sub-multiples method (MBE is not used) */
 
   /* Shift samples in buffer (rolling analysis window of 4 frames) */
+  FXP_STAGE(C2PROF_HISTORY);
+  FXP_COUNT(FXP_OP_MEM, 240);
   for(i=0; i<240; i++)
     {
       ctx->nlpsq[i] = ctx->nlpsq[i+80];
@@ -215,23 +442,53 @@ printf("%d\n", gmax_bin);
 
 /* ========================================================================== */
 /*
- * Encode a batch of input speech samples.
- * buf - pointer to an array of 80 signed 16-bit numbers
+ * Push a result to the ring, encoder side. Never blocks.
  */
-static int c2enc_process_samples(struct c2enc_context_s *ctx, int16_t *buf)
+static void c2enc_ring_write(struct c2enc_ring_s *ring, const struct c2enc_frameinfo_s *info)
 {
-  /* Second step: add these samples to the end of the rolling input buffer */
+  uint32_t head = ring->head;
 
-  memmove(ctx->input, ctx->input+CODEC2_INPUTSAMPLES, 3*CODEC2_INPUTSAMPLES * sizeof(int16_t));
-  memcpy(ctx->input + 3*CODEC2_INPUTSAMPLES, buf, CODEC2_INPUTSAMPLES * sizeof(int16_t));
+  if(head - RING_LOAD(&ring->tail) > ring->mask)
+    {
+      ring->dropped++;
+      return;
+    }
+
+  ring->buf[head & ring->mask] = *info;
+  RING_STORE(&ring->head, head + 1);
+}
 
+/* ========================================================================== */
+/*
+ * Encode a frame of input speech samples.
+ * frame - pointer to an array of 80 signed 16-bit numbers, either the
+ * caller's buffer or the partial frame accumulator once filled.
+ */
+static void c2enc_process_frame(struct c2enc_context_s *ctx, const int16_t *frame)
+{
   /* Run the non linear pitch estimation algorithm */
   /* printf("----- frame %d -----\n", ctx->frame); */
-  c2enc_nlp(ctx);
+  c2enc_nlp(ctx, frame);
 
-  ctx->frame +=1;
+  /* Publish the result */
 
-  return 0;
+  if(ctx->out)
+    {
+      ctx->out[ctx->nout++] = ctx->info;
+    }
+
+  if(ctx->ring)
+    {
+      c2enc_ring_write(ctx->ring, &ctx->info);
+    }
+
+  if(ctx->callback)
+    {
+      ctx->callback(ctx->cbarg, &ctx->info);
+    }
+
+  ctx->fill = 0;
+  ctx->frame +=1;
 }
 
 /* ========================================================================== */
@@ -240,18 +497,66 @@ static int c2enc_process_samples(struct c2enc_context_s *ctx, int16_t *buf)
  */
 int c2enc_init(struct c2enc_context_s *ctx)
 {
-  int i;
+  return c2enc_init_cfg(ctx, NULL);
+}
+
+/* ========================================================================== */
+/*
+ * Initialize an encoder context with the given analysis resolution, NULL for
+ * the default (C2ENC_CONFIG_DEFAULT).
+ * Returns 0 on success, -1 if the configuration is not supported.
+ */
+int c2enc_init_cfg(struct c2enc_context_s *ctx, const struct c2enc_config_s *cfg)
+{
+  static const struct c2enc_config_s defcfg = C2ENC_CONFIG_DEFAULT;
+  uint32_t i;
+
+  if(!cfg)
+    {
+      cfg = &defcfg;
+    }
+
+  if((cfg->decim != 1 && cfg->decim != 2 && cfg->decim != 4 && cfg->decim != 5) ||
+     cfg->fftsize < C2ENC_FFTMIN || cfg->fftsize > C2ENC_FFTMAX ||
+     (cfg->fftsize & (cfg->fftsize - 1)) ||
+     cfg->fftsize < 4*CODEC2_INPUTSAMPLES / cfg->decim ||
+     8000u/cfg->decim/F_MIN_S + 2 > ACF_RHOMAX ||
+     (cfg->pitchmode != C2ENC_PITCH_NLP && cfg->pitchmode != C2ENC_PITCH_ACF))
+    {
+      return -1;
+    }
+
+  ctx->fftsize = cfg->fftsize;
+  ctx->decim   = cfg->decim;
+  ctx->winlen  = 4*CODEC2_INPUTSAMPLES / cfg->decim;
+  ctx->binmin  = cfg->fftsize*cfg->decim*F_MIN_S/8000;
+  ctx->binmax  = cfg->fftsize*cfg->decim*F_MAX_S/8000;
+  ctx->lagmin  = 8000/cfg->decim/F_MAX_S;
+  ctx->lagmax  = 8000/cfg->decim/F_MIN_S;
+  c2enc_window(ctx->nlpwin, ctx->winlen);
 
   ctx->frame=0;
+  ctx->fill=0;
+  memset(&ctx->info, 0, sizeof(ctx->info));
+  ctx->ring=NULL;
+  ctx->callback=NULL;
+  ctx->cbarg=NULL;
+  ctx->out=NULL;
+  ctx->nout=0;
+  ctx->pitchmode=cfg->pitchmode;
 
   /* Erase sample history (4 80 sample frames) */
 
   for(i=0;i<CODEC2_INPUTSAMPLES*4;i++)
     {
-      ctx->input[i] = 0;
       ctx->nlpsq[i] = 0;
     }
 
+  for(i=0;i<CODEC2_INPUTSAMPLES;i++)
+    {
+      ctx->input[i] = 0;
+    }
+
   /* Erase NLP detector variables */
 
   ctx->nlpmemx = 0;
@@ -261,24 +566,253 @@ int c2enc_init(struct c2enc_context_s *ctx)
       ctx->nlpmemfir[i] = 0;
     }
 
-  return 0;
+  /* Input is 8 kHz until c2enc_write_rate says otherwise */
+
+  return c2rs_init(&ctx->rs, C2RS_OUTRATE);
 }
 
 /* ========================================================================== */
 /*
  * Write some samples to the encoder.
- * Returns: the number of samples submitted to the encoder, always a multiple
- * of 80.
+ * Any number of samples can be written. Whole frames are encoded straight
+ * from buf, only the samples that complete a pending partial frame or that
+ * start a new one are copied to the accumulator.
+ * Returns: the number of samples consumed (all of them).
  */
-int c2enc_write(struct c2enc_context_s *ctx, int16_t *buf, uint32_t nsamples)
+int c2enc_write(struct c2enc_context_s *ctx, const int16_t *buf, uint32_t nsamples)
 {
   uint32_t done = 0;
-  while(nsamples >= CODEC2_INPUTSAMPLES)
+  uint32_t len;
+
+  /* Complete the pending frame */
+
+  if(ctx->fill)
     {
-      c2enc_process_samples(ctx, buf + done);
+      len = CODEC2_INPUTSAMPLES - ctx->fill;
+      if(len > nsamples)
+        {
+          len = nsamples;
+        }
+      FXP_STAGE(C2PROF_INPUT);
+      FXP_COUNT(FXP_OP_MEM, len);
+      memcpy(ctx->input + ctx->fill, buf, len * sizeof(int16_t));
+      ctx->fill += len;
+      done = len;
+
+      if(ctx->fill == CODEC2_INPUTSAMPLES)
+        {
+          c2enc_process_frame(ctx, ctx->input);
+        }
+    }
+
+  /* Aligned frames, no copy */
+
+  while(nsamples - done >= CODEC2_INPUTSAMPLES)
+    {
+      c2enc_process_frame(ctx, buf + done);
       done += CODEC2_INPUTSAMPLES;
-      nsamples -= CODEC2_INPUTSAMPLES;
     }
+
+  /* Keep the tail for the next call */
+
+  if(done < nsamples)
+    {
+      len = nsamples - done;
+      FXP_STAGE(C2PROF_INPUT);
+      FXP_COUNT(FXP_OP_MEM, len);
+      memcpy(ctx->input + ctx->fill, buf + done, len * sizeof(int16_t));
+      ctx->fill += len;
+      done = nsamples;
+    }
+
   return done;
 }
 
+/* ========================================================================== */
+/*
+ * Encode samples into caller storage. The results of the frames completed by
+ * this call are stored in out, in addition to the ring and callback outputs.
+ * Samples are only consumed up to what out can hold, the caller resubmits the
+ * remaining ones. As with c2enc_write, whole frames are encoded straight from
+ * samples, there is no allocation.
+ * Returns: the number of results stored in out, *consumed is set to the
+ * number of samples consumed.
+ */
+uint32_t c2enc_encode(struct c2enc_context_s *ctx, const int16_t *samples, uint32_t nsamples,
+                      uint32_t *consumed, struct c2enc_frameinfo_s *out, uint32_t maxout)
+{
+  uint64_t room;
+
+  /* Samples that complete maxout frames, plus a partial one */
+
+  room = ((uint64_t)maxout + 1) * CODEC2_INPUTSAMPLES - ctx->fill - 1;
+  if(nsamples > room)
+    {
+      nsamples = room;
+    }
+
+  ctx->out  = out;
+  ctx->nout = 0;
+  *consumed = c2enc_write(ctx, samples, nsamples);
+  ctx->out  = NULL;
+
+  return ctx->nout;
+}
+
+/* ========================================================================== */
+/*
+ * Write some samples at an arbitrary input rate to the encoder.
+ * Samples are resampled to 8 kHz directly into the partial frame
+ * accumulator, and each completed frame is encoded. 8 kHz input goes
+ * through c2enc_write.
+ * Changing the rate resets the resampler history.
+ * Returns: the number of samples consumed (all of them), or -1 if the rate is
+ * not supported (see resample.h).
+ */
+int c2enc_write_rate(struct c2enc_context_s *ctx, const int16_t *buf, uint32_t nsamples, uint32_t rate)
+{
+  uint32_t done = 0;
+  uint32_t used;
+
+  if(rate != ctx->rs.rate)
+    {
+      if(c2rs_init(&ctx->rs, rate) != 0)
+        {
+          return -1;
+        }
+    }
+
+  if(rate == C2RS_OUTRATE)
+    {
+      return c2enc_write(ctx, buf, nsamples);
+    }
+
+  while(done < nsamples)
+    {
+      ctx->fill += c2rs_process(&ctx->rs, buf + done, nsamples - done, &used,
+                                ctx->input + ctx->fill,
+                                CODEC2_INPUTSAMPLES - ctx->fill);
+      done += used;
+
+      if(ctx->fill == CODEC2_INPUTSAMPLES)
+        {
+          c2enc_process_frame(ctx, ctx->input);
+        }
+    }
+
+  return done;
+}
+
+/* ========================================================================== */
+/*
+ * Call a function with the result of each encoded frame, from the thread
+ * that writes samples. NULL disables the callback.
+ */
+void c2enc_set_callback(struct c2enc_context_s *ctx, c2enc_callback_t callback, void *arg)
+{
+  ctx->callback = callback;
+  ctx->cbarg    = arg;
+}
+
+/* ========================================================================== */
+/*
+ * Push the result of each encoded frame to a ring. NULL disables the ring.
+ */
+void c2enc_set_ring(struct c2enc_context_s *ctx, struct c2enc_ring_s *ring)
+{
+  ctx->ring = ring;
+}
+
+/* ========================================================================== */
+/*
+ * Select the pitch estimator, see enum c2enc_pitch_e.
+ * Returns 0 on success, -1 if the mode is unknown.
+ */
+int c2enc_set_pitch(struct c2enc_context_s *ctx, int mode)
+{
+  if(mode != C2ENC_PITCH_NLP && mode != C2ENC_PITCH_ACF)
+    {
+      return -1;
+    }
+  ctx->pitchmode = mode;
+  return 0;
+}
+
+/* ========================================================================== */
+/*
+ * Save the encoder state. This is only possible at a frame boundary, when no
+ * partial frame is pending.
+ * Returns 0 on success, -1 if a partial frame is pending.
+ */
+int c2enc_save(const struct c2enc_context_s *ctx, struct c2enc_state_s *state)
+{
+  if(ctx->fill != 0)
+    {
+      return -1;
+    }
+
+  state->frame    = ctx->frame;
+  state->reserved = 0;
+  state->nlpmemx  = ctx->nlpmemx;
+  state->nlpmemy  = ctx->nlpmemy;
+  memcpy(state->nlpsq, ctx->nlpsq, sizeof(state->nlpsq));
+  memcpy(state->nlpmemfir, ctx->nlpmemfir, sizeof(state->nlpmemfir));
+  return 0;
+}
+
+/* ========================================================================== */
+/*
+ * Restore a saved encoder state into an initialized context. The pending
+ * partial frame and the resampler history are dropped.
+ */
+void c2enc_restore(struct c2enc_context_s *ctx, const struct c2enc_state_s *state)
+{
+  ctx->frame   = state->frame;
+  ctx->fill    = 0;
+  ctx->nlpmemx = state->nlpmemx;
+  ctx->nlpmemy = state->nlpmemy;
+  memcpy(ctx->nlpsq, state->nlpsq, sizeof(state->nlpsq));
+  memcpy(ctx->nlpmemfir, state->nlpmemfir, sizeof(state->nlpmemfir));
+  c2rs_init(&ctx->rs, ctx->rs.rate);
+}
+
+/* ========================================================================== */
+/*
+ * Initialize a result ring on caller storage of size entries.
+ * Returns 0 on success, -1 if size is not a power of two.
+ */
+int c2enc_ring_init(struct c2enc_ring_s *ring, struct c2enc_frameinfo_s *buf, uint32_t size)
+{
+  if(size == 0 || (size & (size - 1)))
+    {
+      return -1;
+    }
+
+  ring->buf     = buf;
+  ring->mask    = size - 1;
+  ring->head    = 0;
+  ring->tail    = 0;
+  ring->dropped = 0;
+
+  return 0;
+}
+
+/* ========================================================================== */
+/*
+ * Pop a result from the ring, consumer side.
+ * Returns 1 if a result was read, 0 if the ring is empty.
+ */
+int c2enc_ring_read(struct c2enc_ring_s *ring, struct c2enc_frameinfo_s *info)
+{
+  uint32_t tail = ring->tail;
+
+  if(tail == RING_LOAD(&ring->head))
+    {
+      return 0;
+    }
+
+  *info = ring->buf[tail & ring->mask];
+  RING_STORE(&ring->tail, tail + 1);
+
+  return 1;
+}
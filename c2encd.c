@@ -0,0 +1,350 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* c2encd - shared memory encoder daemon.
+ * Channels are statically assigned to a fixed set of worker threads
+ * (channel % workers), each pinned to its own core, so a channel encoder
+ * context stays in the cache of one core. Workers poll their channels and
+ * encode everything that is queued in one batch per channel. */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "c2fxp.h"
+#include "c2encd.h"
+
+#define MAXWORKERS 64
+#define IDLE_NS    500000 /* sleep when a worker found nothing to do */
+
+struct worker_s
+{
+  pthread_t thread;
+  int index;
+  int cpu; /* -1: not pinned */
+};
+
+static struct c2encd_shm_s *shm;
+static int nworkers = 1;
+static volatile sig_atomic_t running = 1;
+
+/* ========================================================================== */
+static void on_signal(int sig)
+{
+  running = 0;
+}
+
+/* ========================================================================== */
+/* Encoder callback: push the result to the channel output ring */
+static void worker_output(void *arg, const struct c2enc_frameinfo_s *info)
+{
+  struct c2encd_channel_s *chan = arg;
+  uint32_t head = chan->outhead;
+
+  if(head - C2ENCD_LOAD(&chan->outtail) >= C2ENCD_OUTRING)
+    {
+      C2ENCD_STORE(&chan->dropped, chan->dropped + 1);
+      return;
+    }
+
+  chan->out[head & (C2ENCD_OUTRING - 1)] = *info;
+  C2ENCD_STORE(&chan->outhead, head + 1);
+}
+
+/* ========================================================================== */
+/*
+ * Encode all queued samples of a channel, returns the number of samples.
+ * Samples at a rate the encoder refuses are left in the ring and the channel
+ * is closed.
+ */
+static uint32_t worker_channel(struct c2enc_context_s *ctx, struct c2encd_channel_s *chan)
+{
+  uint32_t tail = chan->intail;
+  uint32_t head = C2ENCD_LOAD(&chan->inhead);
+  uint32_t pos, len;
+  uint32_t done = 0;
+
+  /* Encode in place from the ring, one call per contiguous part */
+
+  while(tail != head)
+    {
+      pos = tail & (C2ENCD_PCMRING - 1);
+      len = C2ENCD_PCMRING - pos;
+      if(len > head - tail)
+        {
+          len = head - tail;
+        }
+      if(c2enc_write_rate(ctx, chan->pcm + pos, len, chan->rate) < 0)
+        {
+          fprintf(stderr, "channel of producer %u: unsupported rate %u\n",
+                  C2ENCD_PID(chan->owner), chan->rate);
+          C2ENCD_STORE(&chan->owner, C2ENCD_OWNER(C2ENCD_CLOSING, C2ENCD_PID(chan->owner)));
+          break;
+        }
+      tail += len;
+      done += len;
+    }
+
+  C2ENCD_STORE(&chan->intail, tail);
+  return done;
+}
+
+/* ========================================================================== */
+static void *worker_main(void *arg)
+{
+  struct worker_s *w = arg;
+  struct c2enc_context_s *ctx;
+  uint8_t *open;
+  struct timespec idle = { 0, IDLE_NS };
+  struct c2encd_channel_s *chan;
+  uint32_t work;
+  uint32_t ch, k, state;
+  uint32_t nown = (shm->nchannels - w->index + nworkers - 1) / nworkers;
+  cpu_set_t cpus;
+
+  if(w->cpu >= 0)
+    {
+      CPU_ZERO(&cpus);
+      CPU_SET(w->cpu, &cpus);
+      if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+        {
+          fprintf(stderr, "worker %d: cannot pin to cpu %d\n", w->index, w->cpu);
+        }
+    }
+
+  /* Contexts are allocated by the worker, after pinning, so that they are
+   * local to its core. Only for its own channels: k = ch / nworkers. */
+
+  ctx  = calloc(nown, sizeof(struct c2enc_context_s));
+  open = calloc(nown, 1);
+  if(!ctx || !open)
+    {
+      fprintf(stderr, "worker %d: out of memory\n", w->index);
+      running = 0;
+      goto retfree;
+    }
+
+  while(running)
+    {
+      work = 0;
+
+      for(ch = w->index, k = 0; ch < shm->nchannels; ch += nworkers, k++)
+        {
+          chan  = &shm->ch[ch];
+          state = C2ENCD_STATE(C2ENCD_LOAD(&chan->owner));
+
+          if(state == C2ENCD_CLOSING)
+            {
+              open[k] = 0;
+              C2ENCD_STORE(&chan->owner, C2ENCD_OWNER(C2ENCD_FREE, 0));
+              continue;
+            }
+
+          if(state != C2ENCD_ACTIVE)
+            {
+              continue;
+            }
+
+          if(!open[k])
+            {
+              if(c2enc_init(&ctx[k]) != 0)
+                {
+                  fprintf(stderr, "channel %u: cannot initialize the encoder\n", ch);
+                  C2ENCD_STORE(&chan->owner, C2ENCD_OWNER(C2ENCD_CLOSING, C2ENCD_PID(chan->owner)));
+                  continue;
+                }
+              c2enc_set_callback(&ctx[k], worker_output, chan);
+              open[k] = 1;
+            }
+
+          work += worker_channel(&ctx[k], chan);
+        }
+
+      if(!work)
+        {
+          nanosleep(&idle, NULL);
+        }
+    }
+
+retfree:
+  free(open);
+  free(ctx);
+  return NULL;
+}
+
+/* ========================================================================== */
+/*
+ * Release the channels of producers that exited without closing them, also
+ * those that died while setting a channel up. The pid is claimed with the
+ * channel, a claimed channel always has one.
+ */
+static void reap_channels(void)
+{
+  struct c2encd_channel_s *chan;
+  uint64_t owner;
+  uint32_t ch, state, pid;
+
+  for(ch = 0; ch < shm->nchannels; ch++)
+    {
+      chan  = &shm->ch[ch];
+      owner = C2ENCD_LOAD(&chan->owner);
+      state = C2ENCD_STATE(owner);
+      pid   = C2ENCD_PID(owner);
+      if((state == C2ENCD_ACTIVE || state == C2ENCD_CLAIMED) &&
+         kill(pid, 0) < 0 && errno == ESRCH &&
+         __atomic_compare_exchange_n(&chan->owner, &owner, C2ENCD_OWNER(C2ENCD_CLOSING, pid), 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+          fprintf(stderr, "channel %u: producer %u is gone\n", ch, pid);
+        }
+    }
+}
+
+/* ========================================================================== */
+int main(int argc, char **argv)
+{
+  const char *name = C2ENCD_NAME;
+  struct worker_s workers[MAXWORKERS];
+  uint32_t nchannels = C2ENCD_MAXCHANNELS;
+  int firstcpu = -1;
+  int started = 0;
+  int force = 0;
+  int ret = 1;
+  int fd;
+  int opt;
+  int i;
+
+  while((opt = getopt(argc, argv, "n:w:c:C:f")) != -1)
+    {
+      switch(opt)
+        {
+          case 'n':
+            name = optarg;
+            break;
+          case 'w':
+            nworkers = atoi(optarg);
+            break;
+          case 'c':
+            firstcpu = atoi(optarg);
+            break;
+          case 'C':
+            nchannels = strtoul(optarg, NULL, 0);
+            break;
+          case 'f':
+            force = 1;
+            break;
+          default:
+            fprintf(stderr, "usage: %s [-n shmname] [-w workers] [-c firstcpu] [-C channels] [-f]\n", argv[0]);
+            return 1;
+        }
+    }
+
+  if(nworkers < 1 || nworkers > MAXWORKERS || nchannels < 1 || nchannels > C2ENCD_MAXCHANNELS)
+    {
+      fprintf(stderr, "1..%d workers, 1..%d channels\n", MAXWORKERS, C2ENCD_MAXCHANNELS);
+      return 1;
+    }
+
+  /* Every worker serves at least one channel */
+
+  if((uint32_t)nworkers > nchannels)
+    {
+      nworkers = nchannels;
+    }
+
+  /* An existing object belongs to a running daemon, or was left by one that
+   * crashed: only -f removes it */
+
+  if(force)
+    {
+      shm_unlink(name);
+    }
+
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fd < 0)
+    {
+      fprintf(stderr, "cannot create %s (%s)%s\n", name, strerror(errno),
+              (errno == EEXIST) ? ", use -f if no daemon is running" : "");
+      return 1;
+    }
+
+  if(ftruncate(fd, sizeof(struct c2encd_shm_s)) < 0)
+    {
+      fprintf(stderr, "cannot size %s (%s)\n", name, strerror(errno));
+      goto retunlink;
+    }
+
+  shm = mmap(NULL, sizeof(struct c2encd_shm_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(shm == MAP_FAILED)
+    {
+      fprintf(stderr, "cannot map %s (%s)\n", name, strerror(errno));
+      goto retunlink;
+    }
+
+  memset(shm, 0, sizeof(struct c2encd_shm_s));
+  shm->version   = C2ENCD_VERSION;
+  shm->nchannels = nchannels;
+  shm->pid       = getpid();
+  C2ENCD_STORE(&shm->magic, C2ENCD_MAGIC); /* clients may connect */
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  for(started=0; started<nworkers; started++)
+    {
+      workers[started].index = started;
+      workers[started].cpu   = (firstcpu < 0) ? -1 : firstcpu + started;
+      if(pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0)
+        {
+          fprintf(stderr, "cannot start worker %d\n", started);
+          running = 0;
+          break;
+        }
+    }
+
+  fprintf(stderr, "%s: %u channels, %d workers\n", name, nchannels, nworkers);
+
+  while(running)
+    {
+      sleep(1);
+      reap_channels();
+    }
+
+  for(i=0; i<started; i++)
+    {
+      pthread_join(workers[i].thread, NULL);
+    }
+
+  munmap(shm, sizeof(struct c2encd_shm_s));
+  ret = 0;
+
+retunlink:
+  close(fd);
+  shm_unlink(name);
+  return ret;
+}
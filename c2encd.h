@@ -0,0 +1,113 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* c2encd - shared memory encoder daemon, shared layout and client API */
+
+#ifndef __C2ENCD__H__
+#define __C2ENCD__H__
+
+#include <stdint.h>
+#include "c2fxp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The daemon creates one POSIX shared memory object holding a fixed table of
+ * channels. A producer process claims a free channel, pushes PCM into the
+ * channel input ring and pulls frame results from its output ring. Both rings
+ * are single producer, single consumer: the channel owner on one side, the
+ * daemon worker that owns the channel on the other. The daemon closes the
+ * channels of producers that exit without closing them, and channels whose
+ * samples it cannot encode. The client API is in the c2encd_client library. */
+
+#define C2ENCD_NAME        "/c2encd"
+#define C2ENCD_MAGIC       0x44453243UL /* "C2ED" */
+#define C2ENCD_VERSION     2
+#define C2ENCD_MAXCHANNELS 64
+#define C2ENCD_PCMRING     4096 /* samples, power of two */
+#define C2ENCD_OUTRING     64   /* frame results, power of two */
+
+/* Keep indices written by different processes on different cache lines */
+#define C2ENCD_ALIGN __attribute__((aligned(64)))
+
+#define C2ENCD_LOAD(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define C2ENCD_STORE(p,v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+enum c2encd_state_e
+{
+  C2ENCD_FREE,    /* available */
+  C2ENCD_CLAIMED, /* being set up by a producer */
+  C2ENCD_ACTIVE,  /* encoding */
+  C2ENCD_CLOSING  /* released by the producer, reset by the daemon */
+};
+
+/* The state and the producer pid are one word, so that a producer claims a
+ * channel and records its pid in the same compare and swap */
+
+#define C2ENCD_OWNER(state,pid) ((uint64_t)(pid) << 32 | (state))
+#define C2ENCD_STATE(owner)     ((uint32_t)(owner))
+#define C2ENCD_PID(owner)       ((uint32_t)((owner) >> 32))
+
+struct c2encd_channel_s
+{
+  uint64_t owner; /* C2ENCD_OWNER(), pid 0 when free */
+  uint32_t rate;  /* input sample rate */
+
+  /* Input ring, written by the producer */
+  uint32_t inhead C2ENCD_ALIGN;
+  uint32_t intail C2ENCD_ALIGN;
+  int16_t  pcm[C2ENCD_PCMRING];
+
+  /* Output ring, written by the daemon */
+  uint32_t outhead C2ENCD_ALIGN;
+  uint32_t dropped;
+  uint32_t outtail C2ENCD_ALIGN;
+  struct c2enc_frameinfo_s out[C2ENCD_OUTRING];
+};
+
+struct c2encd_shm_s
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nchannels;
+  uint32_t pid; /* daemon */
+  struct c2encd_channel_s ch[C2ENCD_MAXCHANNELS];
+};
+
+/* Client side */
+
+struct c2encd_client_s
+{
+  int fd;
+  struct c2encd_shm_s *shm;
+};
+
+int c2encd_connect(struct c2encd_client_s *cl, const char *name);
+void c2encd_disconnect(struct c2encd_client_s *cl);
+int c2encd_open(struct c2encd_client_s *cl, uint32_t rate);
+void c2encd_close(struct c2encd_client_s *cl, int ch);
+uint32_t c2encd_push(struct c2encd_client_s *cl, int ch, const int16_t *pcm, uint32_t nsamples);
+uint32_t c2encd_pending(struct c2encd_client_s *cl, int ch);
+uint32_t c2encd_pull(struct c2encd_client_s *cl, int ch, struct c2enc_frameinfo_s *info, uint32_t max);
+uint32_t c2encd_dropped(struct c2encd_client_s *cl, int ch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C2ENCD__H__ */
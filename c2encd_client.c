@@ -0,0 +1,201 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* c2encd - client API, used by producer processes */
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "resample.h"
+#include "c2encd.h"
+
+/* ========================================================================== */
+/*
+ * Map the shared memory of a running daemon. name NULL uses C2ENCD_NAME.
+ * Returns 0 on success, -1 on error.
+ */
+int c2encd_connect(struct c2encd_client_s *cl, const char *name)
+{
+  void *map;
+
+  cl->fd = shm_open(name ? name : C2ENCD_NAME, O_RDWR, 0);
+  if(cl->fd < 0)
+    {
+      return -1;
+    }
+
+  map = mmap(NULL, sizeof(struct c2encd_shm_s), PROT_READ | PROT_WRITE, MAP_SHARED, cl->fd, 0);
+  if(map == MAP_FAILED)
+    {
+      close(cl->fd);
+      return -1;
+    }
+
+  cl->shm = map;
+
+  if(cl->shm->magic != C2ENCD_MAGIC || cl->shm->version != C2ENCD_VERSION)
+    {
+      c2encd_disconnect(cl);
+      return -1;
+    }
+
+  return 0;
+}
+
+/* ========================================================================== */
+void c2encd_disconnect(struct c2encd_client_s *cl)
+{
+  munmap(cl->shm, sizeof(struct c2encd_shm_s));
+  close(cl->fd);
+  cl->shm = NULL;
+  cl->fd  = -1;
+}
+
+/* ========================================================================== */
+/*
+ * Claim a free channel for input at the given rate (see c2enc_write_rate).
+ * Returns the channel number, or -1 if the rate is not supported or all
+ * channels are in use.
+ */
+int c2encd_open(struct c2encd_client_s *cl, uint32_t rate)
+{
+  struct c2encd_channel_s *chan;
+  struct c2rs_s rs;
+  uint64_t expect;
+  uint32_t pid = getpid();
+  uint32_t i;
+
+  /* The daemon would refuse the samples, refuse the channel instead */
+
+  if(c2rs_init(&rs, rate) != 0)
+    {
+      return -1;
+    }
+
+  for(i=0; i<cl->shm->nchannels; i++)
+    {
+      chan   = &cl->shm->ch[i];
+      expect = C2ENCD_OWNER(C2ENCD_FREE, 0);
+      if(!__atomic_compare_exchange_n(&chan->owner, &expect, C2ENCD_OWNER(C2ENCD_CLAIMED, pid), 0,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+          continue;
+        }
+
+      chan->rate    = rate;
+      chan->inhead  = 0;
+      chan->intail  = 0;
+      chan->outhead = 0;
+      chan->outtail = 0;
+      chan->dropped = 0;
+
+      /* The daemon starts encoding once it sees the channel active */
+
+      C2ENCD_STORE(&chan->owner, C2ENCD_OWNER(C2ENCD_ACTIVE, pid));
+      return i;
+    }
+
+  return -1;
+}
+
+/* ========================================================================== */
+/*
+ * Release a channel. Samples not yet encoded are discarded.
+ */
+void c2encd_close(struct c2encd_client_s *cl, int ch)
+{
+  C2ENCD_STORE(&cl->shm->ch[ch].owner, C2ENCD_OWNER(C2ENCD_CLOSING, getpid()));
+}
+
+/* ========================================================================== */
+/*
+ * Push samples to a channel. Never blocks.
+ * Returns the number of samples queued, less than nsamples if the ring is
+ * full.
+ */
+uint32_t c2encd_push(struct c2encd_client_s *cl, int ch, const int16_t *pcm, uint32_t nsamples)
+{
+  struct c2encd_channel_s *chan = &cl->shm->ch[ch];
+  uint32_t head = chan->inhead;
+  uint32_t room = C2ENCD_PCMRING - (head - C2ENCD_LOAD(&chan->intail));
+  uint32_t pos, len;
+
+  if(nsamples > room)
+    {
+      nsamples = room;
+    }
+
+  /* Up to two copies around the end of the ring */
+
+  pos = head & (C2ENCD_PCMRING - 1);
+  len = C2ENCD_PCMRING - pos;
+  if(len > nsamples)
+    {
+      len = nsamples;
+    }
+  memcpy(chan->pcm + pos, pcm, len * sizeof(int16_t));
+  memcpy(chan->pcm, pcm + len, (nsamples - len) * sizeof(int16_t));
+
+  C2ENCD_STORE(&chan->inhead, head + nsamples);
+  return nsamples;
+}
+
+/* ========================================================================== */
+/*
+ * Number of pushed samples the daemon has not consumed yet.
+ */
+uint32_t c2encd_pending(struct c2encd_client_s *cl, int ch)
+{
+  struct c2encd_channel_s *chan = &cl->shm->ch[ch];
+
+  return chan->inhead - C2ENCD_LOAD(&chan->intail);
+}
+
+/* ========================================================================== */
+/*
+ * Pull at most max frame results from a channel. Never blocks.
+ * Returns the number of results.
+ */
+uint32_t c2encd_pull(struct c2encd_client_s *cl, int ch, struct c2enc_frameinfo_s *info, uint32_t max)
+{
+  struct c2encd_channel_s *chan = &cl->shm->ch[ch];
+  uint32_t tail = chan->outtail;
+  uint32_t head = C2ENCD_LOAD(&chan->outhead);
+  uint32_t n = 0;
+
+  while(tail != head && n < max)
+    {
+      info[n++] = chan->out[tail & (C2ENCD_OUTRING - 1)];
+      tail++;
+    }
+
+  C2ENCD_STORE(&chan->outtail, tail);
+  return n;
+}
+
+/* ========================================================================== */
+/*
+ * Number of frame results of a channel dropped because its output ring was
+ * full, since it was opened.
+ */
+uint32_t c2encd_dropped(struct c2encd_client_s *cl, int ch)
+{
+  return C2ENCD_LOAD(&cl->shm->ch[ch].dropped);
+}
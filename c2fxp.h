@@ -22,7 +22,13 @@
 #define __C2ENC__H__
 
 #include <stdint.h>
+#include <stddef.h>
 #include "fxpmath.h"
+#include "resample.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /*
  * The input samples are signed 16-bit numbers interpreted as fixed point
@@ -32,29 +38,181 @@
 /* ========================================================================== */
 /* Common stuff */
 
-/* This is the number of samples that must be fed to the encoder */
+/* This is the number of samples encoded per frame */
 #define CODEC2_INPUTSAMPLES 80
-#define CODEC2_FFTSAMPLES 512
+#define CODEC2_FFTSAMPLES 512 /* default NLP FFT size */
 
 /* ========================================================================== */
 /* Encoder stuff */
 
+/* Precision of the NLP pipeline (squared samples, filters and FFT), chosen at
+ * compile time. Q15 (default) halves the buffers, intermediates are Q31 in
+ * both cases. Define C2FXP_NLP_Q31 for Q31 storage. */
+
+#ifdef C2FXP_NLP_Q31
+typedef q31_t nlp_t;
+#define NLPBITS Q31BITS
+#else
+typedef q15_t nlp_t;
+#define NLPBITS Q15BITS
+#endif
+
+/* Analysis resolution, chosen at init time with c2enc_init_cfg().
+ * The 4-frame analysis window is decimated by decim, giving 320/decim
+ * samples, then zero padded to fftsize for the NLP FFT.
+ * decim:   1, 2, 4 or 5 (the 600 Hz low pass limits it to 6)
+ * fftsize: 128 to C2ENC_FFTMAX, power of two, at least 320/decim
+ * Examples: 128/5 economy (12.5 Hz bins), 512/5 default (3.125 Hz),
+ * 1024/5 high accuracy (1.56 Hz). C2ENC_FFTMAX sizes the context buffers, it
+ * is set with the C2FXP_FFTMAX CMake variable, a power of two from 512
+ * (default) to 2048: 1024 enables the high accuracy resolutions (+2 KB per
+ * context in Q15). It is never below CODEC2_FFTSAMPLES, so that the default
+ * configuration always fits. */
+
+#ifndef C2ENC_FFTMAX
+#define C2ENC_FFTMAX 512
+#endif
+#define C2ENC_FFTMIN 128
+#define C2ENC_WINMAX (4*CODEC2_INPUTSAMPLES) /* decimated samples at decim 1 */
+
+struct c2enc_config_s
+{
+  uint16_t fftsize;
+  uint16_t decim;
+  uint16_t pitchmode; /* enum c2enc_pitch_e, see also c2enc_set_pitch() */
+};
+
+#define C2ENC_CONFIG_DEFAULT { CODEC2_FFTSAMPLES, 5, C2ENC_PITCH_NLP }
+
+/* Analysis result of one frame */
+
+struct c2enc_frameinfo_s
+{
+  uint32_t frame;    /* frame number */
+  uint16_t pitchbin; /* pitch, in NLP FFT bins (f0 = bin*8000/(decim*fftsize)) */
+  uint16_t scale;    /* FFT input scaling that was used, power of two */
+  q31_t    peak;     /* NLP peak value, or ACF correlation */
+  uint8_t  voiced;   /* peak stands out of the pitch search range, see c2enc.c */
+  uint8_t  decim;    /* analysis resolution of pitchbin */
+  uint16_t fftsize;
+};
+
+/* Lock-free single producer (encoder), single consumer ring of results.
+ * The storage is provided by the caller, size must be a power of two.
+ * When the ring is full new results are dropped and counted. */
+
+struct c2enc_ring_s
+{
+  struct c2enc_frameinfo_s *buf;
+  uint32_t mask;
+  uint32_t head;    /* next write, updated by the encoder only */
+  uint32_t tail;    /* next read, updated by the consumer only */
+  uint32_t dropped; /* updated by the encoder only */
+};
+
+/* Pitch estimators, selected per context with c2enc_set_pitch().
+ * Both work on the same decimated buffer (64 samples at 1600 Hz by default).
+ * NLP: zero padded FFT, highest bin in the search range.
+ * ACF: normalized autocorrelation, no FFT. pitchbin is given in the same
+ *      FFT bin units as NLP, peak is the correlation coefficient in Q31. */
+
+enum c2enc_pitch_e
+{
+  C2ENC_PITCH_NLP,
+  C2ENC_PITCH_ACF
+};
+
+typedef void (*c2enc_callback_t)(void *arg, const struct c2enc_frameinfo_s *info);
+
+/* Encoder state, allocated by the caller. Its layout depends on
+ * C2FXP_NLP_Q31 and C2ENC_FFTMAX, applications must be built with the same
+ * values as the library (the CMake targets export both). */
+
 struct c2enc_context_s
 {
-  q15_t input[4*CODEC2_INPUTSAMPLES]; /* buffer for input samples, 4 frames */
+  q15_t input[CODEC2_INPUTSAMPLES]; /* partial frame accumulator */
+  uint32_t fill; /* number of samples in input */
   uint32_t frame;
   uint32_t logframe;
+  struct c2enc_frameinfo_s info; /* result of the last encoded frame */
+
+  /* Result outputs, both optional */
+  struct c2enc_ring_s *ring;
+  c2enc_callback_t callback;
+  void *cbarg;
+  struct c2enc_frameinfo_s *out; /* caller storage during c2enc_encode */
+  uint32_t nout;
+
+  int pitchmode; /* enum c2enc_pitch_e */
+
+  /* Analysis resolution, see struct c2enc_config_s */
+  uint16_t fftsize;
+  uint16_t decim;
+  uint16_t winlen;         /* decimated samples */
+  uint16_t binmin, binmax; /* NLP pitch search range */
+  uint16_t lagmin, lagmax; /* ACF pitch search range */
+  q15_t nlpwin[C2ENC_WINMAX]; /* Hanning window, generated for winlen */
 
   /* NLP */
-  q15_t nlpsq[4*CODEC2_INPUTSAMPLES]; /* buffer for squared input samples, 4 frames */
+  nlp_t nlpsq[4*CODEC2_INPUTSAMPLES]; /* buffer for squared input samples, 4 frames */
   q31_t nlpmemx, nlpmemy; /* NLP notch registers, longer precision */
-  q15_t nlpmemfir[48]; /* NLP FIR filter registers */
-  q15_t nlpfftr[CODEC2_FFTSAMPLES]; /* Sample buffer for FFT */
-  q15_t nlpffti[CODEC2_FFTSAMPLES];
+  nlp_t nlpmemfir[48]; /* NLP FIR filter registers */
+  nlp_t nlpfftr[C2ENC_FFTMAX]; /* Sample buffer for FFT, ACF samples */
+  union /* the ACF does not use the imaginary part */
+    {
+      nlp_t nlpffti[C2ENC_FFTMAX];
+      int32_t acfrho[C2ENC_FFTMAX * sizeof(nlp_t) / sizeof(int32_t)]; /* correlation per lag, Q15 */
+    };
+
+  /* Input resampler */
+  struct c2rs_s rs;
 };
 
-int c2enc_init(struct c2enc_context_s *ctx);
-int c2enc_write(struct c2enc_context_s *ctx, int16_t *samples, uint32_t nsamples);
+/* Encoder state at a frame boundary, enough to resume encoding at frame
+ * number frame from PCM sample frame*CODEC2_INPUTSAMPLES with the same
+ * results as an uninterrupted encoder. The configuration, outputs and
+ * resampler history are not part of it. */
+
+struct c2enc_state_s
+{
+  uint32_t frame;    /* next frame to encode */
+  uint32_t reserved;
+  q31_t nlpmemx, nlpmemy;
+  nlp_t nlpsq[3*CODEC2_INPUTSAMPLES]; /* squared sample history */
+  nlp_t nlpmemfir[48];
+};
+
+C2FXP_API int c2enc_init(struct c2enc_context_s *ctx);
+C2FXP_API int c2enc_init_cfg(struct c2enc_context_s *ctx, const struct c2enc_config_s *cfg);
+C2FXP_API int c2enc_write(struct c2enc_context_s *ctx, const int16_t *samples, uint32_t nsamples);
+C2FXP_API int c2enc_write_rate(struct c2enc_context_s *ctx, const int16_t *samples, uint32_t nsamples, uint32_t rate);
+C2FXP_API uint32_t c2enc_encode(struct c2enc_context_s *ctx, const int16_t *samples, uint32_t nsamples,
+                                uint32_t *consumed, struct c2enc_frameinfo_s *out, uint32_t maxout);
+C2FXP_API void c2enc_set_callback(struct c2enc_context_s *ctx, c2enc_callback_t callback, void *arg);
+C2FXP_API void c2enc_set_ring(struct c2enc_context_s *ctx, struct c2enc_ring_s *ring);
+C2FXP_API int c2enc_set_pitch(struct c2enc_context_s *ctx, int mode);
+C2FXP_API int c2enc_save(const struct c2enc_context_s *ctx, struct c2enc_state_s *state);
+C2FXP_API void c2enc_restore(struct c2enc_context_s *ctx, const struct c2enc_state_s *state);
+
+C2FXP_API int c2enc_ring_init(struct c2enc_ring_s *ring, struct c2enc_frameinfo_s *buf, uint32_t size);
+C2FXP_API int c2enc_ring_read(struct c2enc_ring_s *ring, struct c2enc_frameinfo_s *info);
+
+/* ========================================================================== */
+/* Segment-parallel encoder */
+
+/* A long 8 kHz recording is split in one segment per thread, each encoded by
+ * its own context. Each segment starts encoding C2ENC_PAR_WARMUP frames
+ * early so that the notch, FIR and 4-frame NLP history have converged to the
+ * serial encoder state when its first frame is reached. The results of the
+ * warm-up frames are discarded. The segment contexts live in caller memory
+ * of c2enc_parallel_size() bytes, the encoder does not allocate. */
+
+#define C2ENC_PAR_WARMUP 8
+
+C2FXP_API size_t c2enc_parallel_size(int nthreads);
+C2FXP_API int c2enc_encode_parallel(const int16_t *samples, uint32_t nframes, struct c2enc_frameinfo_s *info,
+                                    const struct c2enc_config_s *cfg, int nthreads, uint32_t warmup,
+                                    void *work);
 
 /* ========================================================================== */
 /* Decoder stuff */
@@ -64,8 +222,12 @@ struct c2dec_context_s
   int dummy;
 };
 
-int c2dec_init(struct c2dec_context_s *ctx);
-int c2dec_write(struct c2dec_context_s *ctx, uint8_t *buf, uint32_t nsamples);
+C2FXP_API int c2dec_init(struct c2dec_context_s *ctx);
+C2FXP_API int c2dec_write(struct c2dec_context_s *ctx, uint8_t *buf, uint32_t nsamples);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* __C2ENC__H__ */
 
@@ -0,0 +1,151 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* c2sdump - print frames of a c2s container, from any position */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "c2fxp.h"
+#include "c2stream.h"
+
+/* ========================================================================== */
+/* Time random frame lookups */
+static void c2sdump_seekbench(const struct c2s_reader_s *r, uint32_t count)
+{
+  struct c2enc_frameinfo_s info;
+  struct timespec t0, t1;
+  uint32_t i, sum = 0;
+  uint32_t seed = 1;
+  double t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for(i=0; i<count; i++)
+    {
+      seed = seed * 1664525 + 1013904223;
+      if(c2s_read(r, r->hdr.first + seed % r->foot.nframes, &info) == 0)
+        {
+          sum += info.pitchbin;
+        }
+    }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+  printf("%u random reads: %.1f ns/read (%u)\n", count, t * 1e9 / count, sum);
+}
+
+/* ========================================================================== */
+int main(int argc, char **argv)
+{
+  struct c2s_reader_s r;
+  struct c2enc_frameinfo_s info;
+  struct c2enc_state_s state;
+  struct stat st;
+  void *base;
+  uint32_t first, count, bench = 0;
+  uint32_t i;
+  int64_t sync;
+  int fd, opt;
+  int ret = 1;
+
+  while((opt = getopt(argc, argv, "b:")) != -1)
+    {
+      switch(opt)
+        {
+          case 'b':
+            bench = strtoul(optarg, NULL, 0);
+            break;
+          default:
+            fprintf(stderr, "usage: %s [-b reads] stream.c2s [first [count]]\n", argv[0]);
+            return 1;
+        }
+    }
+
+  if(optind >= argc)
+    {
+      fprintf(stderr, "usage: %s [-b reads] stream.c2s [first [count]]\n", argv[0]);
+      return 1;
+    }
+
+  fd = open(argv[optind], O_RDONLY);
+  if(fd < 0 || fstat(fd, &st) < 0)
+    {
+      fprintf(stderr, "cannot open: %s (%s)\n", argv[optind], strerror(errno));
+      return 1;
+    }
+
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED)
+    {
+      fprintf(stderr, "cannot map: %s (%s)\n", argv[optind], strerror(errno));
+      return 1;
+    }
+
+  if(c2s_reader_open(&r, base, st.st_size) != 0)
+    {
+      fprintf(stderr, "not a c2s stream: %s\n", argv[optind]);
+      goto retunmap;
+    }
+
+  if(r.foot.nframes == 0)
+    {
+      printf("no frames, %u-point FFT, decimation %u\n", r.hdr.fftsize, r.hdr.decim);
+      ret = 0;
+      goto retunmap;
+    }
+
+  first = (optind + 1 < argc) ? strtoul(argv[optind + 1], NULL, 0) : r.hdr.first;
+  count = (optind + 2 < argc) ? strtoul(argv[optind + 2], NULL, 0) : r.foot.nframes;
+
+  printf("frames %u-%u, %u per block, %u-point FFT, decimation %u, Q%u sync states\n",
+         r.hdr.first, r.hdr.first + r.foot.nframes - 1, r.hdr.interval,
+         r.hdr.fftsize, r.hdr.decim, r.hdr.nlpbits);
+
+  sync = c2s_sync(&r, first, &state);
+  if(sync >= 0)
+    {
+      printf("resume at frame %lld\n", (long long)sync);
+    }
+
+  for(i=0; i<count; i++)
+    {
+      if(c2s_read(&r, first + i, &info) != 0)
+        {
+          break;
+        }
+      printf("%u %u %u\n", info.frame, info.pitchbin, info.voiced);
+    }
+
+  if(bench)
+    {
+      c2sdump_seekbench(&r, bench);
+    }
+  ret = 0;
+
+retunmap:
+  munmap(base, st.st_size);
+  return ret;
+}
@@ -0,0 +1,340 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* c2s - seekable container for encoded frames, see c2stream.h */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "c2fxp.h"
+#include "c2stream.h"
+
+/* Sync records are padded to keep the frame records and the index aligned */
+#define C2S_SYNCSIZE  ((sizeof(struct c2s_sync_s) + 7) & ~7UL)
+#define C2S_FRAMESIZE sizeof(struct c2enc_frameinfo_s)
+
+/* Frame results are encoded in batches of this size before being stored */
+#define C2S_BATCH 16
+
+/* ========================================================================== */
+/*
+ * Start a stream for the frames of an encoder context, which must be at a
+ * frame boundary. Blocks hold interval frames, 0 for C2S_INTERVAL.
+ * Returns the number of bytes of header stored in out, 0 if out is too small
+ * or the context has a partial frame pending.
+ */
+uint32_t c2s_writer_init(struct c2s_writer_s *w, const struct c2enc_context_s *ctx,
+                         uint32_t interval, uint8_t *out, uint32_t max)
+{
+  struct c2s_header_s hdr;
+
+  if(max < sizeof(hdr) || ctx->fill != 0)
+    {
+      return 0;
+    }
+
+  if(interval == 0)
+    {
+      interval = C2S_INTERVAL;
+    }
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic     = C2S_MAGIC;
+  hdr.version   = C2S_VERSION;
+  hdr.nlpbits   = NLPBITS;
+  hdr.fftsize   = ctx->fftsize;
+  hdr.decim     = ctx->decim;
+  hdr.pitchmode = ctx->pitchmode;
+  hdr.interval  = interval;
+  hdr.first     = ctx->frame;
+  hdr.syncsize  = C2S_SYNCSIZE;
+  hdr.framesize = C2S_FRAMESIZE;
+  memcpy(out, &hdr, sizeof(hdr));
+
+  w->interval = interval;
+  w->nextsync = ctx->frame;
+  w->nsync    = 0;
+  w->nframes  = 0;
+  w->offset   = sizeof(hdr);
+  w->index    = 0;
+  w->nindex   = 0;
+  w->done     = 0;
+
+  return sizeof(hdr);
+}
+
+/* ========================================================================== */
+/*
+ * Encode 8 kHz samples and store the resulting records in out. Encoding stops
+ * at each block boundary to store the sync record, and when out is full.
+ * Returns the number of bytes stored in out, *consumed is set to the number
+ * of samples consumed. The caller resubmits the samples that were not.
+ */
+uint32_t c2s_encode(struct c2s_writer_s *w, struct c2enc_context_s *ctx,
+                    const int16_t *samples, uint32_t nsamples, uint32_t *consumed,
+                    uint8_t *out, uint32_t max)
+{
+  struct c2enc_frameinfo_s batch[C2S_BATCH];
+  struct c2s_sync_s sync;
+  uint32_t pos = 0;
+  uint32_t done = 0;
+  uint32_t len, room, used, n;
+
+  while(done < nsamples)
+    {
+      /* Sync record at the start of each block, once it has samples */
+
+      if(ctx->frame == w->nextsync && ctx->fill == 0)
+        {
+          if(max - pos < C2S_SYNCSIZE)
+            {
+              break;
+            }
+          memset(&sync, 0, sizeof(sync));
+          sync.magic = C2S_SYNCMAGIC;
+          c2enc_save(ctx, &sync.state);
+          memcpy(out + pos, &sync, sizeof(sync));
+          memset(out + pos + sizeof(sync), 0, C2S_SYNCSIZE - sizeof(sync));
+          pos         += C2S_SYNCSIZE;
+          w->nsync    += 1;
+          w->nextsync += w->interval;
+        }
+
+      /* Samples up to the next block boundary, results that fit in out */
+
+      len = (w->nextsync - ctx->frame) * CODEC2_INPUTSAMPLES - ctx->fill;
+      if(len > nsamples - done)
+        {
+          len = nsamples - done;
+        }
+
+      room = (max - pos) / C2S_FRAMESIZE;
+      if(room > C2S_BATCH)
+        {
+          room = C2S_BATCH;
+        }
+
+      n = c2enc_encode(ctx, samples + done, len, &used, batch, room);
+      memcpy(out + pos, batch, n * C2S_FRAMESIZE);
+      pos        += n * C2S_FRAMESIZE;
+      done       += used;
+      w->nframes += n;
+
+      if(used == 0)
+        {
+          break;
+        }
+    }
+
+  *consumed  = done;
+  w->offset += pos;
+  return pos;
+}
+
+/* ========================================================================== */
+/*
+ * End the stream: store the index then the footer. Call until it returns 0.
+ * Returns the number of bytes stored in out.
+ */
+uint32_t c2s_finish(struct c2s_writer_s *w, uint8_t *out, uint32_t max)
+{
+  struct c2s_footer_s foot;
+  uint64_t blocksize = C2S_SYNCSIZE + (uint64_t)w->interval * C2S_FRAMESIZE;
+  uint64_t off;
+  uint32_t pos = 0;
+
+  if(w->index == 0)
+    {
+      w->index = w->offset;
+    }
+
+  /* All blocks but the last one are full */
+
+  while(w->nindex < w->nsync && max - pos >= sizeof(off))
+    {
+      off = sizeof(struct c2s_header_s) + w->nindex * blocksize;
+      memcpy(out + pos, &off, sizeof(off));
+      pos       += sizeof(off);
+      w->nindex += 1;
+    }
+
+  if(w->nindex == w->nsync && !w->done && max - pos >= sizeof(foot))
+    {
+      memset(&foot, 0, sizeof(foot));
+      foot.index   = w->index;
+      foot.nsync   = w->nsync;
+      foot.nframes = w->nframes;
+      foot.magic   = C2S_ENDMAGIC;
+      memcpy(out + pos, &foot, sizeof(foot));
+      pos    += sizeof(foot);
+      w->done = 1;
+    }
+
+  w->offset += pos;
+  return pos;
+}
+
+/* ========================================================================== */
+/*
+ * Open a complete stream of size bytes at base. Nothing is copied, base must
+ * stay valid while the reader is used.
+ * Returns 0 on success, -1 if this is not a valid stream.
+ */
+int c2s_reader_open(struct c2s_reader_s *r, const void *base, uint64_t size)
+{
+  uint64_t data;
+
+  if(size < sizeof(r->hdr) + sizeof(r->foot))
+    {
+      return -1;
+    }
+
+  r->base = base;
+  r->size = size;
+  memcpy(&r->hdr, r->base, sizeof(r->hdr));
+  memcpy(&r->foot, r->base + size - sizeof(r->foot), sizeof(r->foot));
+
+  if(r->hdr.magic != C2S_MAGIC || r->hdr.version != C2S_VERSION ||
+     r->hdr.framesize != C2S_FRAMESIZE || r->hdr.interval == 0 ||
+     r->hdr.syncsize < sizeof(uint32_t) || r->foot.magic != C2S_ENDMAGIC)
+    {
+      return -1;
+    }
+
+  /* The index must fit between the header and the footer and end at the
+   * footer. Sizes are subtracted from known bounds so that nothing wraps. */
+
+  data = size - sizeof(r->hdr) - sizeof(r->foot);
+  if(r->foot.nsync > data / sizeof(uint64_t) ||
+     r->foot.index != size - sizeof(r->foot) - (uint64_t)r->foot.nsync * sizeof(uint64_t))
+    {
+      return -1;
+    }
+
+  /* The frames must fit in the blocks, and the blocks before the index */
+
+  data = r->foot.index - sizeof(r->hdr);
+  if(r->foot.nframes > (uint64_t)r->foot.nsync * r->hdr.interval ||
+     (uint64_t)r->foot.nsync * r->hdr.syncsize > data ||
+     r->foot.nframes > (data - (uint64_t)r->foot.nsync * r->hdr.syncsize) / C2S_FRAMESIZE)
+    {
+      return -1;
+    }
+
+  return 0;
+}
+
+/* ========================================================================== */
+/*
+ * Encoder configuration of the stream, pitch estimator included, for
+ * c2enc_init_cfg.
+ */
+void c2s_reader_config(const struct c2s_reader_s *r, struct c2enc_config_s *cfg)
+{
+  cfg->fftsize   = r->hdr.fftsize;
+  cfg->decim     = r->hdr.decim;
+  cfg->pitchmode = r->hdr.pitchmode;
+}
+
+/* ========================================================================== */
+/*
+ * Offset of the block that holds a frame, -1 if it is not in the stream.
+ * The index entry comes from the file: it must leave room for the sync
+ * record between the header and the index. Checks are written so that
+ * they cannot wrap.
+ */
+static int64_t c2s_block(const struct c2s_reader_s *r, uint32_t frame)
+{
+  uint64_t off;
+  uint32_t block;
+
+  if(frame < r->hdr.first || frame - r->hdr.first >= r->foot.nframes)
+    {
+      return -1;
+    }
+
+  block = (frame - r->hdr.first) / r->hdr.interval;
+  memcpy(&off, r->base + r->foot.index + (uint64_t)block * sizeof(off), sizeof(off));
+  if(off < sizeof(r->hdr) || off > r->foot.index ||
+     r->foot.index - off < r->hdr.syncsize)
+    {
+      return -1;
+    }
+
+  return off;
+}
+
+/* ========================================================================== */
+/*
+ * Read the record of a frame, given its number.
+ * Returns 0 on success, -1 if the frame is not in the stream.
+ */
+int c2s_read(const struct c2s_reader_s *r, uint32_t frame, struct c2enc_frameinfo_s *info)
+{
+  int64_t off;
+  uint64_t rec;
+
+  off = c2s_block(r, frame);
+  if(off < 0)
+    {
+      return -1;
+    }
+
+  /* Offset of the record in the block, it must end before the index */
+
+  rec = r->hdr.syncsize + (uint64_t)((frame - r->hdr.first) % r->hdr.interval) * C2S_FRAMESIZE;
+  if(rec > r->foot.index - off || r->foot.index - off - rec < C2S_FRAMESIZE)
+    {
+      return -1;
+    }
+
+  memcpy(info, r->base + off + rec, C2S_FRAMESIZE);
+  return 0;
+}
+
+/* ========================================================================== */
+/*
+ * Get the encoder state of the last sync point at or before a frame. Encoding
+ * resumes from the returned frame number with c2enc_restore.
+ * Returns the frame number of the sync point, -1 if the frame is not in the
+ * stream or the stream was written with another NLP precision.
+ */
+int64_t c2s_sync(const struct c2s_reader_s *r, uint32_t frame, struct c2enc_state_s *state)
+{
+  struct c2s_sync_s sync;
+  int64_t off;
+
+  if(r->hdr.nlpbits != NLPBITS || r->hdr.syncsize != C2S_SYNCSIZE)
+    {
+      return -1;
+    }
+
+  off = c2s_block(r, frame);
+  if(off < 0)
+    {
+      return -1;
+    }
+
+  memcpy(&sync, r->base + off, sizeof(sync));
+  if(sync.magic != C2S_SYNCMAGIC)
+    {
+      return -1;
+    }
+
+  *state = sync.state;
+  return state->frame;
+}
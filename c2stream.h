@@ -0,0 +1,124 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* c2s - seekable container for encoded frames */
+
+#ifndef __C2STREAM__H__
+#define __C2STREAM__H__
+
+#include <stdint.h>
+#include "c2fxp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Layout, all fields in host (little endian) byte order:
+ *
+ *   header                  struct c2s_header_s
+ *   block 0                 sync record, then up to interval frame records
+ *   block 1
+ *   ...
+ *   index                   nsync uint64_t, file offset of each block
+ *   footer                  struct c2s_footer_s, the last bytes of the file
+ *
+ * A sync record holds the encoder state at the start of its block, so that
+ * encoding can be resumed there (see c2enc_restore). A frame record is a
+ * struct c2enc_frameinfo_s. The footer is at a fixed distance from the end,
+ * so a reader of a memory mapped file finds any frame with two loads: the
+ * index entry of its block, then the record. The stream is written
+ * sequentially into caller buffers, the index is only written at the end.
+ */
+
+#define C2S_MAGIC     0x53463243UL /* "C2FS" */
+#define C2S_SYNCMAGIC 0x59533243UL /* "C2SY" */
+#define C2S_ENDMAGIC  0x45533243UL /* "C2SE" */
+#define C2S_VERSION   1
+#define C2S_INTERVAL  250 /* default frames per block, 5 s */
+
+struct c2s_header_s
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t nlpbits;   /* precision of the sync states, see nlp_t */
+  uint16_t fftsize;   /* encoder configuration */
+  uint8_t  decim;
+  uint8_t  pitchmode;
+  uint32_t interval;  /* frames per block */
+  uint32_t first;     /* number of the first frame */
+  uint32_t syncsize;  /* bytes per sync record */
+  uint32_t framesize; /* bytes per frame record */
+  uint32_t reserved[3];
+};
+
+struct c2s_sync_s
+{
+  uint32_t magic;
+  uint32_t reserved;
+  struct c2enc_state_s state;
+};
+
+struct c2s_footer_s
+{
+  uint64_t index;   /* file offset of the index */
+  uint32_t nsync;
+  uint32_t nframes;
+  uint32_t reserved;
+  uint32_t magic;
+};
+
+/* Writer */
+
+struct c2s_writer_s
+{
+  uint32_t interval;
+  uint32_t nextsync; /* frame number of the next sync record */
+  uint32_t nsync;
+  uint32_t nframes;
+  uint64_t offset;   /* bytes written so far */
+  uint64_t index;    /* offset of the index, set when the frames end */
+  uint32_t nindex;   /* index entries written */
+  uint32_t done;
+};
+
+C2FXP_API uint32_t c2s_writer_init(struct c2s_writer_s *w, const struct c2enc_context_s *ctx,
+                                   uint32_t interval, uint8_t *out, uint32_t max);
+C2FXP_API uint32_t c2s_encode(struct c2s_writer_s *w, struct c2enc_context_s *ctx,
+                              const int16_t *samples, uint32_t nsamples, uint32_t *consumed,
+                              uint8_t *out, uint32_t max);
+C2FXP_API uint32_t c2s_finish(struct c2s_writer_s *w, uint8_t *out, uint32_t max);
+
+/* Reader, on a complete stream in memory (usually a mapped file) */
+
+struct c2s_reader_s
+{
+  const uint8_t *base;
+  uint64_t size;
+  struct c2s_header_s hdr;
+  struct c2s_footer_s foot;
+};
+
+C2FXP_API int c2s_reader_open(struct c2s_reader_s *r, const void *base, uint64_t size);
+C2FXP_API void c2s_reader_config(const struct c2s_reader_s *r, struct c2enc_config_s *cfg);
+C2FXP_API int c2s_read(const struct c2s_reader_s *r, uint32_t frame, struct c2enc_frameinfo_s *info);
+C2FXP_API int64_t c2s_sync(const struct c2s_reader_s *r, uint32_t frame, struct c2enc_state_s *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C2STREAM__H__ */
@@ -0,0 +1,150 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* c2encd producer example: push a raw file through the daemon, print the
+ * pitch bins like c2enc does. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "c2encd.h"
+
+#define PACKET_MS 20
+
+/* ========================================================================== */
+static void feed_pull(struct c2encd_client_s *cl, int ch)
+{
+  struct c2enc_frameinfo_s info[C2ENCD_OUTRING];
+  uint32_t n, i;
+
+  while((n = c2encd_pull(cl, ch, info, C2ENCD_OUTRING)) > 0)
+    {
+      for(i=0; i<n; i++)
+        {
+          printf("%u\n", info[i].pitchbin);
+        }
+    }
+}
+
+/* ========================================================================== */
+int main(int argc, char **argv)
+{
+  struct c2encd_client_s cl;
+  const char *name = NULL;
+  uint32_t rate = 8000;
+  struct timespec wait = { 0, 1000000 };
+  int16_t *buf;
+  uint32_t pkt, done;
+  ssize_t len;
+  int fd, ch, opt;
+  int ret = 1;
+
+  while((opt = getopt(argc, argv, "n:r:")) != -1)
+    {
+      switch(opt)
+        {
+          case 'n':
+            name = optarg;
+            break;
+          case 'r':
+            rate = strtoul(optarg, NULL, 0);
+            break;
+          default:
+            fprintf(stderr, "usage: %s [-n shmname] [-r rate] file.raw\n", argv[0]);
+            return 1;
+        }
+    }
+
+  if(optind >= argc)
+    {
+      fprintf(stderr, "usage: %s [-n shmname] [-r rate] file.raw\n", argv[0]);
+      return 1;
+    }
+
+  pkt = rate * PACKET_MS / 1000;
+  buf = malloc(pkt * sizeof(int16_t));
+  if(!buf)
+    {
+      return 1;
+    }
+
+  fd = open(argv[optind], O_RDONLY);
+  if(fd < 0)
+    {
+      fprintf(stderr, "cannot open: %s (%s)\n", argv[optind], strerror(errno));
+      goto retfree;
+    }
+
+  if(c2encd_connect(&cl, name) != 0)
+    {
+      fprintf(stderr, "cannot connect to the daemon\n");
+      goto retclose;
+    }
+
+  ch = c2encd_open(&cl, rate);
+  if(ch < 0)
+    {
+      fprintf(stderr, "no free channel, or unsupported rate %u\n", rate);
+      goto retdisconnect;
+    }
+
+  while((len = read(fd, buf, pkt * sizeof(int16_t))) > 0)
+    {
+      done = 0;
+      while(done < len / sizeof(int16_t))
+        {
+          done += c2encd_push(&cl, ch, buf + done, len / sizeof(int16_t) - done);
+          feed_pull(&cl, ch);
+          if(done < len / sizeof(int16_t))
+            {
+              nanosleep(&wait, NULL); /* ring full */
+            }
+        }
+    }
+
+  /* Wait for the daemon to consume everything. Results are published
+   * before the input ring index, so they are all there once it is empty. */
+
+  while(c2encd_pending(&cl, ch))
+    {
+      feed_pull(&cl, ch);
+      nanosleep(&wait, NULL);
+    }
+  feed_pull(&cl, ch);
+
+  if(c2encd_dropped(&cl, ch))
+    {
+      fprintf(stderr, "%u results dropped\n", c2encd_dropped(&cl, ch));
+    }
+
+  c2encd_close(&cl, ch);
+  ret = 0;
+
+retdisconnect:
+  c2encd_disconnect(&cl);
+retclose:
+  close(fd);
+retfree:
+  free(buf);
+  return ret;
+}
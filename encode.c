@@ -24,25 +24,373 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "c2fxp.h"
+#include "c2cache.h"
+#include "c2stream.h"
+#include "opcount.h"
 
-/* Read RAW input file, format is 8000 Hz Mono, int16_t */
+/* Read RAW input file, format is Mono, int16_t, 8000 Hz unless -r is used */
 
 #define NSAMPLES CODEC2_INPUTSAMPLES
 #define BUFSIZE (NSAMPLES * sizeof(int16_t))
+#define MAXRATIO 6 /* 48 kHz input */
+#define STREAMBUF 4096 /* container output buffer */
+#define CACHESIZE (16 << 20) /* on-disk cache file */
+#define CACHEFRAMES 2048     /* longest cached input, frames */
 
 struct c2enc_context_s ctx;
 
+/* Binary dump of the frame results, text on stdout if NULL */
+static FILE *dump;
+
+/* ========================================================================== */
+/* Output the result of one frame */
+static void encode_output(void *arg, const struct c2enc_frameinfo_s *info)
+{
+  if(dump)
+    {
+      fwrite(info, sizeof(*info), 1, dump);
+    }
+  else
+    {
+      printf("%u\n", info->pitchbin);
+    }
+}
+
+/* ========================================================================== */
+/* Encode the whole file at once, split across threads */
+static int encode_parallel(int fd, const struct c2enc_config_s *cfg, int nthreads)
+{
+  struct stat st;
+  int16_t *samples;
+  struct c2enc_frameinfo_s *info;
+  void *work;
+  uint32_t nframes;
+  uint32_t i;
+  ssize_t len;
+  size_t done = 0;
+  int ret = 1;
+
+  if(fstat(fd, &st) < 0)
+    {
+      fprintf(stderr, "cannot stat input (%s)\n", strerror(errno));
+      return 1;
+    }
+
+  /* whole frames, last one padded, plus the zero frame that the serial loop
+   * encodes at end of file, so that both give the same frames */
+
+  nframes = (st.st_size + BUFSIZE - 1) / BUFSIZE + 1;
+  samples = calloc(nframes, BUFSIZE);
+  info    = malloc(nframes * sizeof(struct c2enc_frameinfo_s));
+  work    = malloc(c2enc_parallel_size(nthreads));
+  if(!samples || !info || !work)
+    {
+      fprintf(stderr, "cannot allocate %u frames\n", nframes);
+      goto retfree;
+    }
+
+  while(done < st.st_size)
+    {
+      len = read(fd, (uint8_t*)samples + done, st.st_size - done);
+      if(len <= 0)
+        {
+          break;
+        }
+      done += len;
+    }
+
+  if(c2enc_encode_parallel(samples, nframes, info, cfg, nthreads, C2ENC_PAR_WARMUP, work) != 0)
+    {
+      fprintf(stderr, "parallel encoding failed: %u point FFT, decimation %u\n", cfg->fftsize, cfg->decim);
+      goto retfree;
+    }
+
+  for(i=0; i<nframes; i++)
+    {
+      encode_output(NULL, &info[i]);
+    }
+  ret = 0;
+
+retfree:
+  free(work);
+  free(info);
+  free(samples);
+  return ret;
+}
+
+/* ========================================================================== */
+/* Encode the whole file at once through an on-disk cache, 8 kHz input */
+static int encode_cached(int fd, const char *name)
+{
+  struct c2cache_s cache;
+  struct c2cache_stats_s st;
+  struct stat sti;
+  int16_t *samples;
+  struct c2enc_frameinfo_s *info;
+  uint32_t nframes;
+  int32_t i, n;
+  ssize_t len;
+  size_t done = 0;
+  void *mem = MAP_FAILED;
+  int cfd;
+  int ret = 1;
+
+  if(fstat(fd, &sti) < 0)
+    {
+      fprintf(stderr, "cannot stat input (%s)\n", strerror(errno));
+      return 1;
+    }
+
+  nframes = sti.st_size / BUFSIZE;
+  samples = malloc(sti.st_size + 1);
+  info    = malloc((nframes + 1) * sizeof(struct c2enc_frameinfo_s));
+  if(!samples || !info)
+    {
+      fprintf(stderr, "cannot allocate %u frames\n", nframes);
+      goto retfree;
+    }
+
+  while(done < sti.st_size)
+    {
+      len = read(fd, (uint8_t*)samples + done, sti.st_size - done);
+      if(len <= 0)
+        {
+          break;
+        }
+      done += len;
+    }
+
+  /* The cache is used by one process at a time, see c2cache.h */
+
+  cfd = open(name, O_RDWR | O_CREAT, 0644);
+  if(cfd < 0 || flock(cfd, LOCK_EX) < 0 || ftruncate(cfd, CACHESIZE) < 0)
+    {
+      fprintf(stderr, "cannot open cache: %s (%s)\n", name, strerror(errno));
+      goto retclose;
+    }
+
+  mem = mmap(NULL, CACHESIZE, PROT_READ | PROT_WRITE, MAP_SHARED, cfd, 0);
+  if(mem == MAP_FAILED || c2cache_open(&cache, mem, CACHESIZE, CACHEFRAMES) < 0)
+    {
+      fprintf(stderr, "cannot map cache: %s\n", name);
+      goto retclose;
+    }
+
+  n = c2cache_encode(&cache, &ctx, samples, done / sizeof(int16_t), info, nframes + 1);
+  for(i=0; i<n; i++)
+    {
+      encode_output(NULL, &info[i]);
+    }
+
+  c2cache_stats(&cache, &st);
+  fprintf(stderr, "cache: %llu hits, %llu misses, %llu evictions, %llu bypass, %u/%u slots\n",
+          (unsigned long long)st.hits, (unsigned long long)st.misses,
+          (unsigned long long)st.evictions, (unsigned long long)st.bypass, st.used, st.nslots);
+  ret = 0;
+
+retclose:
+  if(mem != MAP_FAILED)
+    {
+      munmap(mem, CACHESIZE);
+    }
+  if(cfd >= 0)
+    {
+      close(cfd);
+    }
+
+retfree:
+  free(info);
+  free(samples);
+  return ret;
+}
+
+/* ========================================================================== */
+/* Encode to a seekable container, 8 kHz input */
+static int encode_stream(int fd, const char *name)
+{
+  static uint8_t out[STREAMBUF];
+  struct c2s_writer_s w;
+  int16_t samples[NSAMPLES];
+  FILE *f;
+  ssize_t len;
+  uint32_t n, used, done;
+  int ret = 1;
+
+  f = fopen(name, "wb");
+  if(!f)
+    {
+      fprintf(stderr, "cannot create: %s (%s)\n", name, strerror(errno));
+      return 1;
+    }
+
+  n = c2s_writer_init(&w, &ctx, 0, out, sizeof(out));
+  fwrite(out, 1, n, f);
+
+  while((len = read(fd, samples, BUFSIZE)) > 0)
+    {
+      /* whole frames, last one padded */
+      memset((uint8_t*)samples + len, 0, BUFSIZE - len);
+
+      for(done = 0; done < NSAMPLES; done += used)
+        {
+          n = c2s_encode(&w, &ctx, samples + done, NSAMPLES - done, &used, out, sizeof(out));
+          fwrite(out, 1, n, f);
+        }
+    }
+
+  while((n = c2s_finish(&w, out, sizeof(out))) > 0)
+    {
+      fwrite(out, 1, n, f);
+    }
+
+  if(ferror(f))
+    {
+      fprintf(stderr, "cannot write: %s\n", name);
+    }
+  else
+    {
+      ret = 0;
+    }
+
+  if(fclose(f) != 0)
+    {
+      ret = 1;
+    }
+  return ret;
+}
+
 /* ========================================================================== */
 int main(int argc, char **argv)
 {
   int fd;
   uint16_t *buf = NULL;
   int ret = 0;
+  int opt;
+  uint32_t rate = C2RS_OUTRATE;
+  uint32_t bufsize;
+  int nthreads = 0;
+  const char *dumpname = NULL;
+  const char *streamname = NULL;
+  const char *cachename = NULL;
+  const char *target = NULL;
+  int pitchmode = C2ENC_PITCH_NLP;
+  struct c2enc_config_s cfg = C2ENC_CONFIG_DEFAULT;
+#ifdef C2FXP_OPCOUNT
+  const struct c2prof_cost_s *cost = NULL;
+  struct c2prof_cost_s filecost;
+#endif
+
+  while((opt = getopt(argc, argv, "r:j:p:o:m:f:d:c:k:")) != -1)
+    {
+      switch(opt)
+        {
+          case 'r':
+            rate = strtoul(optarg, NULL, 0);
+            break;
+          case 'j':
+            nthreads = atoi(optarg);
+            break;
+          case 'p':
+            target = optarg;
+            break;
+          case 'o':
+            dumpname = optarg;
+            break;
+          case 'k':
+            cachename = optarg;
+            break;
+          case 'c':
+            streamname = optarg;
+            break;
+          case 'f':
+            cfg.fftsize = strtoul(optarg, NULL, 0);
+            break;
+          case 'd':
+            cfg.decim = strtoul(optarg, NULL, 0);
+            break;
+          case 'm':
+            pitchmode = !strcmp(optarg, "acf") ? C2ENC_PITCH_ACF :
+                        !strcmp(optarg, "nlp") ? C2ENC_PITCH_NLP : -1;
+            break;
+          default:
+            fprintf(stderr, "usage: %s [-r rate] [-j threads] [-p m4|m0|ops|costfile] [-o results.bin] [-m nlp|acf] [-f fftsize] [-d decim] [-c stream.c2s] [-k cache] file.raw\n", argv[0]);
+            return 1;
+        }
+    }
+
+  if(optind >= argc)
+    {
+      fprintf(stderr, "usage: %s [-r rate] [-j threads] [-p m4|m0|ops|costfile] [-o results.bin] [-m nlp|acf] [-f fftsize] [-d decim] [-c stream.c2s] [-k cache] file.raw\n", argv[0]);
+      return 1;
+    }
+
+  if(target)
+    {
+#ifdef C2FXP_OPCOUNT
+      cost = c2prof_cost(target);
+      if(!cost)
+        {
+          if(c2prof_loadcost(&filecost, target) != 0)
+            {
+              fprintf(stderr, "cannot load cost table: %s\n", target);
+              return 1;
+            }
+          cost = &filecost;
+        }
+      if(nthreads)
+        {
+          fprintf(stderr, "profiling needs serial encoding\n");
+          return 1;
+        }
+      c2prof_reset();
+#else
+      fprintf(stderr, "built without C2FXP_OPCOUNT, cannot profile\n");
+      return 1;
+#endif
+    }
+
+  if(pitchmode < 0)
+    {
+      fprintf(stderr, "unknown pitch estimator\n");
+      return 1;
+    }
+
+  cfg.pitchmode = pitchmode;
+
+  if((streamname || cachename) && (nthreads || rate != C2RS_OUTRATE))
+    {
+      fprintf(stderr, "container and cache need serial encoding of 8000 Hz input\n");
+      return 1;
+    }
+
+  if(streamname && cachename)
+    {
+      fprintf(stderr, "cannot use a container and a cache together\n");
+      return 1;
+    }
+
+  if(nthreads && rate != C2RS_OUTRATE)
+    {
+      fprintf(stderr, "parallel encoding needs 8000 Hz input\n");
+      return 1;
+    }
 
   printf("sizeof(struct c2enc_context_s) = %lu\n", sizeof(struct c2enc_context_s));
-  buf = malloc(BUFSIZE);
+
+  /* read one encoder frame worth of input per iteration */
+
+  bufsize = (uint64_t)BUFSIZE * rate / C2RS_OUTRATE;
+  if(bufsize == 0 || bufsize > BUFSIZE * MAXRATIO)
+    {
+      fprintf(stderr, "unsupported rate %u\n", rate);
+      return 1;
+    }
+  buf = malloc(bufsize);
 
   if (!buf)
     {
@@ -50,36 +398,84 @@ int main(int argc, char **argv)
       return 1;
     }
 
-  fd = open(argv[1], O_RDONLY);
+  fd = open(argv[optind], O_RDONLY);
 
   if(fd<0)
     {
-      fprintf(stderr, "cannot open: %s (%s)\n", argv[1], strerror(errno));
+      fprintf(stderr, "cannot open: %s (%s)\n", argv[optind], strerror(errno));
       ret = 1;
       goto retfree;
     }
 
-  ret = c2enc_init(&ctx);
+  if(dumpname)
+    {
+      dump = fopen(dumpname, "wb");
+      if(!dump)
+        {
+          fprintf(stderr, "cannot create: %s (%s)\n", dumpname, strerror(errno));
+          ret = 1;
+          goto retclose;
+        }
+    }
+
+  if(nthreads)
+    {
+      ret = encode_parallel(fd, &cfg, nthreads);
+      goto retclose;
+    }
+
+  ret = c2enc_init_cfg(&ctx, &cfg);
   if(ret != 0)
     {
-      fprintf(stderr, "encoder init failed\n");
+      fprintf(stderr, "unsupported resolution: %u point FFT, decimation %u\n", cfg.fftsize, cfg.decim);
       ret = 1;
       goto retclose;
     }
 
+  c2enc_set_callback(&ctx, encode_output, NULL);
+  c2enc_set_pitch(&ctx, pitchmode);
+
+  if(streamname)
+    {
+      ret = encode_stream(fd, streamname);
+      goto retclose;
+    }
+
+  if(cachename)
+    {
+      ret = encode_cached(fd, cachename);
+      goto retclose;
+    }
+
   do
     {
-      ret = read(fd, buf, BUFSIZE);
-      if(ret < BUFSIZE)
+      ret = read(fd, buf, bufsize);
+      if(ret < bufsize)
+        {
+          memset((uint8_t*)buf+ret, 0, bufsize - ret); /* pad */
+        }
+      if(c2enc_write_rate(&ctx, (int16_t*)buf, bufsize / sizeof(int16_t), rate) < 0)
         {
-          memset((uint8_t*)buf+ret, 0, BUFSIZE - ret); /* pad */
+          fprintf(stderr, "unsupported rate %u\n", rate);
+          ret = 1;
+          break;
         }
-      c2enc_write(&ctx, buf, NSAMPLES);
 //      printf("Managed %d samples\n", ret );
     }
   while(ret>0);
 
+#ifdef C2FXP_OPCOUNT
+  if(cost)
+    {
+      c2prof_report(stderr, ctx.frame, cost);
+    }
+#endif
+
 retclose:
+  if(dump)
+    {
+      fclose(dump);
+    }
   close(fd);
 
 retfree:
@@ -16,9 +16,12 @@
  */
 
 #include <stdint.h>
+#ifdef TEST
 #include <stdio.h>
+#endif
 
 #include "fxpmath.h"
+#include "fft.h"
 
 /* log2 */
 /* http://stackoverflow.com/questions/11376288/fast-computing-of-log2-for-64-bit-integers */
@@ -45,234 +48,27 @@ uint32_t log2_32(uint32_t value)
 
 
 /* ========================================================================== */
-static inline void q15_swap2(q15_t *arr1, q15_t *arr2, int a, int b)
-{
-  q15_t x;
-  x = arr1[a]; arr1[a] = arr1[b]; arr1[b] = x;
-  x = arr2[a]; arr2[a] = arr2[b]; arr2[b] = x;
-}
-
-static inline void q31_swap2(q31_t *arr1, q31_t *arr2, int a, int b)
-{
-  q31_t x;
-  x = arr1[a]; arr1[a] = arr1[b]; arr1[b] = x;
-  x = arr2[a]; arr2[a] = arr2[b]; arr2[b] = x;
-}
-
-/* ========================================================================== */
-/* Fast Bit reversal */
-/* A FAST RECURSIVE BIT-REVERSAL ALGORITHM
- * Jechang Jeong and William J. Williams, doi:10.1109@ICASSP.1990.115695
- */
-void q15_bitreverse2(q15_t *data1, q15_t *data2, int m)
-{
-  //int br[256]; //enough for 131072 points (m=17, m2=8)
-  //int br[128]; //enough for 32768 points (m=15, m2=7)
-  //int br[64]; //enough for 8192 points (m=13, m2=6)
-  int br[32]; //enough for 2048 points (m=11, m2=5)
-  int m2,c,odd,offset,b_size,i,j,k;
-  m2 = m >> 1;
-  if(m2>5) return; //Error
+/* Q15 samples, Q31 twiddles and intermediates */
 
-  c  = 1 << m2;
-  odd = 0;
-  if(m != m2 << 1)
-    {
-      odd = 1;
-    }
-  offset = 1 << (m - 1);
-  b_size = 2;
-  br[0]=0;
-  br[1]=offset;
-  q15_swap2(data1, data2, 1, offset);
-  if(odd)
-    {
-      q15_swap2(data1, data2, 1 + c, offset + c);
-    }
-  while(b_size < c)
-    {
-      offset >>= 1;
-      for(i = b_size; i < (b_size << 1); i++)
-        {
-          k = br[i - b_size] + offset;
-          br[i]=k;
-          q15_swap2(data1, data2, i, k);
-          if(odd)
-            {
-              q15_swap2(data1, data2, i+c, k+c);
-            }
-          for(j = 1; j < i; j++)
-            {
-              q15_swap2(data1, data2, i + br[j], k + j);
-              if(odd)
-                {
-                  q15_swap2(data1, data2, i + br[j] + c, k + j + c);
-                }
-            }
-        }
-      b_size <<= 1;
-    }
-}
-
-void q31_bitreverse2(q31_t *data1, q31_t *data2, int m)
-{
-  //int br[256]; //enough for 131072 points (m=17, m2=8)
-  //int br[128]; //enough for 32768 points (m=15, m2=7)
-  //int br[64]; //enough for 8192 points (m=13, m2=6)
-  int br[32]; //enough for 2048 points (m=11, m2=5)
-  int m2,c,odd,offset,b_size,i,j,k;
-  m2 = m >> 1;
-  if(m2>5) return; //Error
-
-  c  = 1 << m2;
-  odd = 0;
-  if(m != m2 << 1)
-    {
-      odd = 1;
-    }
-  offset = 1 << (m - 1);
-  b_size = 2;
-  br[0]=0;
-  br[1]=offset;
-  q31_swap2(data1, data2, 1, offset);
-  if(odd)
-    {
-      q31_swap2(data1, data2, 1 + c, offset + c);
-    }
-  while(b_size < c)
-    {
-      offset >>= 1;
-      for(i = b_size; i < (b_size << 1); i++)
-        {
-          k = br[i - b_size] + offset;
-          br[i]=k;
-          q31_swap2(data1, data2, i, k);
-          if(odd)
-            {
-              q31_swap2(data1, data2, i+c, k+c);
-            }
-          for(j = 1; j < i; j++)
-            {
-              q31_swap2(data1, data2, i + br[j], k + j);
-              if(odd)
-                {
-                  q31_swap2(data1, data2, i + br[j] + c, k + j + c);
-                }
-            }
-        }
-      b_size <<= 1;
-    }
-}
-
-/* ========================================================================== */
-#include <math.h>
-void cordicfq15(q15_t *vcos, q15_t *vsin, float angle) {
-    *vcos = FTOQ15(cos(angle));
-    *vsin = FTOQ15(sin(angle));
-}
-
-void cordicfq31(q31_t *vcos, q31_t *vsin, float angle) {
-    *vcos = FTOQ31(cos(angle));
-    *vsin = FTOQ31(sin(angle));
-}
+#define FFT_T          q15_t
+#define FFT_NAME(x)    q15_##x
+#define FFT_TOQ31(v)   Q15TOQ31(v)
+#define FFT_FROMQ31(v) Q31TOQ15(v)
+#define FFT_ADD(a,b)   q15_add(a,b)
+#define FFT_SUB(a,b)   q15_sub(a,b)
+#include "fft_impl.h"
 
 /* ========================================================================== */
-/* naive implementation (wikipedia algorithm, with some improvements) */
-/* fixed point conversion needs data scaling, see:
- * https://fr.mathworks.com/help/fixedpoint/ug/convert-fast-fourier-transform-fft-to-fixed-point.html */
-int q15_fft(q15_t *datar, q15_t *datai, uint32_t n)
-{
-  uint32_t s;
-  uint32_t m,m2;
-  uint32_t k;
-  uint32_t j;
-  uint32_t rounds = log2_32(n);
-
-  q31_t wmr, wmi; //complex twiddle factor
-  q31_t wr, wi;
-  q31_t tr, ti;
-  q15_t ur, ui;
-
-  q15_bitreverse2(datar, datai, rounds);
-
-  for(s=1; s<=rounds; s++)
-    {
-      float angle;
-      m = 1 << s;
-      m2 = m >> 1;
-      angle = -2.0*M_PI/(float)m;
-      cordicfq31(&wmr, &wmi, angle);
-      for(k = 0; k < n; k += m)
-        {
-          wr=FTOQ31(0.9); wi=0; /* 0.5 + 0. j */
-
-          for(j = 0 ; j < m2; j++)
-            {
-              q31_cmul(&tr,&ti, wr,wi, Q15TOQ31(datar[k + j + m2]), Q15TOQ31(datai[k + j + m2]));
-
-              ur = datar[k + j];
-              ui = datai[k + j];
+/* Q31 samples */
 
-              datar[k + j] = q15_add(ur, Q31TOQ15(tr));
-              datai[k + j] = q15_add(ui, Q31TOQ15(ti));
+#define FFT_T          q31_t
+#define FFT_NAME(x)    q31_##x
+#define FFT_TOQ31(v)   (v)
+#define FFT_FROMQ31(v) (v)
+#define FFT_ADD(a,b)   q31_add(a,b)
+#define FFT_SUB(a,b)   q31_sub(a,b)
+#include "fft_impl.h"
 
-              datar[k + j + m2] = q15_sub(ur, Q31TOQ15(tr));
-              datai[k + j + m2] = q15_sub(ui, Q31TOQ15(ti));
-
-            q31_cmul(&wr,&wi, wr,wi, wmr,wmi);
-            }
-        }
-    }
-
-  return 0;
-}
-
-int q31_fft(q31_t *datar, q31_t *datai, uint32_t n)
-{
-  uint32_t s;
-  uint32_t m,m2;
-  uint32_t k;
-  uint32_t j;
-  uint32_t rounds = log2_32(n);
-
-  q31_t wmr, wmi; //complex twiddle factor
-  q31_t wr, wi;
-  q31_t tr, ti;
-  q31_t ur, ui;
-
-  q31_bitreverse2(datar, datai, rounds);
-
-  for(s=1; s<=rounds; s++)
-    {
-      float angle;
-      m = 1 << s;
-      m2 = m >> 1;
-      angle = -2.0*M_PI/(float)m;
-      cordicfq31(&wmr, &wmi, angle);
-      for(k = 0; k < n; k += m)
-        {
-          wr=FTOQ31(0.9); wi=0; /* 0.5 + 0. j */
-
-          for(j = 0 ; j < m2; j++)
-            {
-              q31_cmul(&tr,&ti, wr,wi, datar[k + j + m2], datai[k + j + m2]);
-
-              ur = datar[k + j];
-              ui = datai[k + j];
-
-              datar[k + j] = q31_add(ur, tr);
-              datai[k + j] = q31_add(ui, ti);
-
-              datar[k + j + m2] = q31_sub(ur, tr);
-              datai[k + j + m2] = q31_sub(ui, ti);
-
-            q31_cmul(&wr,&wi, wr,wi, wmr,wmi);
-            }
-        }
-    }
-
-  return 0;
-}
 #ifdef TEST
 #define N 8
 
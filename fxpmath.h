@@ -3,8 +3,18 @@
 #ifndef FXPMATH__H
 #define FXPMATH__H
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* Symbols exported by the c2fxp shared library, which is built with hidden
+ * visibility and C2FXP_BUILD defined. */
+
+#if defined(C2FXP_BUILD) && defined(__GNUC__)
+#define C2FXP_API __attribute__((visibility("default")))
+#else
+#define C2FXP_API
+#endif
+
 /* Types */
 
 typedef int16_t q15_t;
@@ -39,6 +49,48 @@ typedef int32_t q31_t;
 #define Q15TOQ31(v) ((v) << (Q31BITS-Q15BITS))
 #define Q31TOQ15(v) ((v) >> (Q31BITS-Q15BITS))
 
+/* Operation counting
+ * When C2FXP_OPCOUNT is defined, each primitive below increments a counter
+ * for its operation type in the current stage. The counter array and the
+ * stage selector are provided by the application (see opcount.c).
+ * Saturation is part of the cost of the saturating arithmetic, FXP_OP_SAT
+ * only counts explicit saturations. Complex multiplications are counted as
+ * a whole, their inner multiplications and additions use the _nc (not
+ * counted) variants. */
+
+enum fxp_op_e
+{
+  FXP_OP_ADD15,  /* q15_add, q15_sub, q15_abs */
+  FXP_OP_ADD31,  /* q31_add, q31_sub, q31_abs */
+  FXP_OP_MUL15,  /* q15_mul */
+  FXP_OP_MUL31,  /* q31_mul */
+  FXP_OP_SAT,    /* q15_sat, q31_sat */
+  FXP_OP_CMUL15, /* q15_cmul */
+  FXP_OP_CMUL31, /* q31_cmul */
+  FXP_OP_MAC,    /* 16x16 multiply accumulate into a wide register */
+  FXP_OP_ITER,   /* one step of an iterative function (CORDIC, sqrt, log2) */
+  FXP_OP_MEM,    /* one sample moved in memory (load+store) */
+  FXP_OP_COUNT
+};
+
+#define FXP_MAXSTAGES 16
+
+#ifdef C2FXP_OPCOUNT
+#ifdef __cplusplus
+extern "C" {
+#endif
+extern uint64_t fxp_opcounts[FXP_MAXSTAGES][FXP_OP_COUNT];
+extern int fxp_opstage;
+#ifdef __cplusplus
+}
+#endif
+#define FXP_COUNT(op,n) ((void)(fxp_opcounts[fxp_opstage][op] += (uint64_t)(int64_t)(n)))
+#define FXP_STAGE(s)    ((void)(fxp_opstage = (s)))
+#else
+#define FXP_COUNT(op,n) ((void)0)
+#define FXP_STAGE(s)    ((void)0)
+#endif
+
 /* Saturation */
 
 static inline q15_t q15_sat_dbg(int32_t val, const char *file, int line)
@@ -57,8 +109,9 @@ static inline q15_t q15_sat_dbg(int32_t val, const char *file, int line)
 
   return (q15_t)val;
 }
+#define q15_sat(v) (FXP_COUNT(FXP_OP_SAT,1), q15_sat_dbg(v,__FILE__,__LINE__))
 
-static inline q31_t q31_sat(int64_t val)
+static inline q31_t q31_sat_nc(int64_t val)
 {
   if(val > (int64_t)(Q31-1))
     {
@@ -75,45 +128,79 @@ static inline q31_t q31_sat(int64_t val)
   return (q31_t)val;
 }
 
+static inline q31_t q31_sat(int64_t val)
+{
+  FXP_COUNT(FXP_OP_SAT, 1);
+  return q31_sat_nc(val);
+}
+
 /* abs */
 
 static inline uint16_t q15_abs(q15_t val)
 {
+  FXP_COUNT(FXP_OP_ADD15, 1);
   if(val>0)
     return (uint16_t)val;
   else
     return (uint16_t)-val;
 }
 
+static inline uint32_t q31_abs(q31_t val)
+{
+  FXP_COUNT(FXP_OP_ADD31, 1);
+  if(val>0)
+    return (uint32_t)val;
+  else
+    return (uint32_t)0 - (uint32_t)val;
+}
+
 /* Saturating addition */
 
+#define q15_add_nc(a,b) q15_sat_dbg((int32_t)(a) + (int32_t)(b), __FILE__,__LINE__)
+
 static inline q15_t q15_add_dbg(q15_t a, q15_t b, const char *file, int line)
 {
+  FXP_COUNT(FXP_OP_ADD15, 1);
   return q15_sat_dbg((int32_t)a + (int32_t)b, file,line);
 }
 #define q15_add(a,b) q15_add_dbg(a,b,__FILE__,__LINE__)
 
+static inline q31_t q31_add_nc(q31_t a, q31_t b)
+{
+  return q31_sat_nc((int64_t)a + (int64_t)b);
+}
+
 static inline q31_t q31_add(q31_t a, q31_t b)
 {
-  return q31_sat((int64_t)a + (int64_t)b);
+  FXP_COUNT(FXP_OP_ADD31, 1);
+  return q31_add_nc(a, b);
 }
 
 /* Saturating subtraction */
 
+#define q15_sub_nc(a,b) q15_sat_dbg((int32_t)(a) - (int32_t)(b), __FILE__,__LINE__)
+
 static inline q15_t q15_sub_dbg(q15_t a, q15_t b, const char *file, int line)
 {
+  FXP_COUNT(FXP_OP_ADD15, 1);
   return q15_sat_dbg((int32_t)a - (int32_t)b, file,line);
 }
 #define q15_sub(a,b) q15_sub_dbg(a,b,__FILE__,__LINE__)
 
+static inline q31_t q31_sub_nc(q31_t a, q31_t b)
+{
+  return q31_sat_nc((int64_t)a - (int64_t)b);
+}
+
 static inline q31_t q31_sub(q31_t a, q31_t b)
 {
-  return q31_sat((int64_t)a - (int64_t)b);
+  FXP_COUNT(FXP_OP_ADD31, 1);
+  return q31_sub_nc(a, b);
 }
 
 /* Multiplication */
 
-static inline q15_t q15_mul_dbg(q15_t a, q15_t b, const char *file, int line)
+static inline q15_t q15_mul_nc_dbg(q15_t a, q15_t b, const char *file, int line)
 {
   int32_t tmp = (int32_t)a * (int32_t)b;
 
@@ -124,9 +211,16 @@ static inline q15_t q15_mul_dbg(q15_t a, q15_t b, const char *file, int line)
 
   return q15_sat_dbg(tmp >> Q15BITS, file,line);
 }
+#define q15_mul_nc(a,b) q15_mul_nc_dbg(a,b,__FILE__,__LINE__)
+
+static inline q15_t q15_mul_dbg(q15_t a, q15_t b, const char *file, int line)
+{
+  FXP_COUNT(FXP_OP_MUL15, 1);
+  return q15_mul_nc_dbg(a, b, file,line);
+}
 #define q15_mul(a,b) q15_mul_dbg(a,b,__FILE__,__LINE__)
 
-static inline q31_t q31_mul(q31_t a, q31_t b)
+static inline q31_t q31_mul_nc(q31_t a, q31_t b)
 {
   int64_t tmp = (int64_t)a * (int64_t)b;
 
@@ -135,25 +229,359 @@ static inline q31_t q31_mul(q31_t a, q31_t b)
   else
     tmp += (Q31>>1); /* Rounding */
 
-  return q31_sat(tmp >> Q31BITS);
+  return q31_sat_nc(tmp >> Q31BITS);
+}
+
+static inline q31_t q31_mul(q31_t a, q31_t b)
+{
+  FXP_COUNT(FXP_OP_MUL31, 1);
+  return q31_mul_nc(a, b);
 }
 
 /* Complex multiplications */
 
 static inline void q15_cmul(q15_t *dr, q15_t *di, q15_t ar, q15_t ai, q15_t br, q15_t bi)
 {
-  q15_t tr = q15_sub(q15_mul(ar, br), q15_mul(ai, bi));
-  q15_t ti = q15_add(q15_mul(ar, bi), q15_mul(br, ai));
+  q15_t tr = q15_sub_nc(q15_mul_nc(ar, br), q15_mul_nc(ai, bi));
+  q15_t ti = q15_add_nc(q15_mul_nc(ar, bi), q15_mul_nc(br, ai));
   *dr = tr;
   *di = ti;
+  FXP_COUNT(FXP_OP_CMUL15, 1);
 }
 
 static inline void q31_cmul(q31_t *dr, q31_t *di, q31_t ar, q31_t ai, q31_t br, q31_t bi)
 {
-  q31_t tr = q31_sub(q31_mul(ar, br), q31_mul(ai, bi));
-  q31_t ti = q31_add(q31_mul(ar, bi), q31_mul(br, ai));
+  q31_t tr = q31_sub_nc(q31_mul_nc(ar, br), q31_mul_nc(ai, bi));
+  q31_t ti = q31_add_nc(q31_mul_nc(ar, bi), q31_mul_nc(br, ai));
   *dr = tr;
   *di = ti;
+  FXP_COUNT(FXP_OP_CMUL31, 1);
+}
+
+/* ========================================================================== */
+/* Elementary functions, pure integer implementations (no libm, no floats) */
+
+/* Angles are binary angles: a full turn is 2^32, so the natural wraparound of
+ * 32-bit arithmetic performs the modulo 2*pi reduction. Read as a signed
+ * value, -2^31..2^31-1 covers -pi..pi. */
+
+typedef uint32_t fxpangle_t;
+
+#define FXPANGLE_PI  0x80000000UL
+#define FXPANGLE_PI2 0x40000000UL
+
+#define DTOANGLE(rad) ((fxpangle_t)(int64_t)((rad) * (2147483648.0 / 3.14159265358979323846)))
+#define ANGLETOD(a)   ((double)(int32_t)(a) * (3.14159265358979323846 / 2147483648.0))
+
+/* Count leading zeros. val must not be zero. */
+
+static inline int fxp_clz32(uint32_t val)
+{
+#ifdef __GNUC__
+  return __builtin_clz(val);
+#else
+  int n = 0;
+  while(!(val & 0x80000000UL))
+    {
+      val <<= 1;
+      n++;
+    }
+  return n;
+#endif
+}
+
+/* CORDIC
+ * fxp_cordic_atan[i] = atan(2^-i) as a binary angle.
+ * Gain compensation 1/prod(sqrt(1+2^-2i)) = 0.607252935 is applied to the
+ * initial vector in rotation mode and to the result in vectoring mode. */
+
+#define FXP_CORDIC_ITER 31
+#define FXP_CORDIC_K_Q30 652032874L
+#define FXP_CORDIC_K_Q31 1304065748L
+
+static const int32_t fxp_cordic_atan[FXP_CORDIC_ITER] =
+{
+  536870912, 316933406, 167458907, 85004756, 42667331, 21354465,
+   10679838,   5340245,   2670163,  1335087,   667544,   333772,
+     166886,     83443,     41722,    20861,    10430,     5215,
+       2608,      1304,       652,      326,      163,       81,
+         41,        20,        10,        5,        3,        1,
+          1,
+};
+
+/* Rotation mode: rotate (K,0) by angle. Results are Q30 so that the
+ * intermediate vector never overflows. */
+
+static inline void fxp_cordic_rotate_nc(fxpangle_t angle, int32_t *vcos, int32_t *vsin, int iter)
+{
+  int32_t x = FXP_CORDIC_K_Q30;
+  int32_t y = 0;
+  int32_t z, t;
+  int neg = 0;
+  int i;
+
+  /* CORDIC converges for |angle| < 99 degrees: fold the left half plane */
+
+  if((angle + FXPANGLE_PI2) & FXPANGLE_PI)
+    {
+      angle += FXPANGLE_PI;
+      neg = 1;
+    }
+  z = (int32_t)angle;
+
+  for(i=0; i<iter; i++)
+    {
+      if(z >= 0)
+        {
+          t  = x - (y >> i);
+          y  = y + (x >> i);
+          z -= fxp_cordic_atan[i];
+        }
+      else
+        {
+          t  = x + (y >> i);
+          y  = y - (x >> i);
+          z += fxp_cordic_atan[i];
+        }
+      x = t;
+    }
+
+  if(neg)
+    {
+      x = -x;
+      y = -y;
+    }
+
+  *vcos = x;
+  *vsin = y;
+}
+
+static inline void fxp_cordic_rotate(fxpangle_t angle, int32_t *vcos, int32_t *vsin, int iter)
+{
+  FXP_COUNT(FXP_OP_ITER, iter);
+  fxp_cordic_rotate_nc(angle, vcos, vsin, iter);
+}
+
+/* sin/cos
+ * Max abs error measured over the full turn against libm:
+ * q31: 1.7e-8 (35 LSB), q15: 3.1e-5 (1 LSB)
+ * q31_sincos_nc is not counted, for tables computed at init. */
+
+static inline void q31_sincos_nc(fxpangle_t angle, q31_t *vcos, q31_t *vsin)
+{
+  int32_t x, y;
+  fxp_cordic_rotate_nc(angle, &x, &y, FXP_CORDIC_ITER);
+  *vcos = q31_sat_nc((int64_t)x * 2);
+  *vsin = q31_sat_nc((int64_t)y * 2);
+}
+
+static inline void q31_sincos(fxpangle_t angle, q31_t *vcos, q31_t *vsin)
+{
+  FXP_COUNT(FXP_OP_ITER, FXP_CORDIC_ITER);
+  FXP_COUNT(FXP_OP_SAT, 2);
+  q31_sincos_nc(angle, vcos, vsin);
+}
+
+static inline void q15_sincos(fxpangle_t angle, q15_t *vcos, q15_t *vsin)
+{
+  int32_t x, y;
+  fxp_cordic_rotate(angle, &x, &y, 17);
+  *vcos = q15_sat((x + (1L << 14)) >> 15);
+  *vsin = q15_sat((y + (1L << 14)) >> 15);
+}
+
+/* Vectoring mode: angle and magnitude of (x,y).
+ * The vector is normalized so that its larger component has its top bit at
+ * bit 28, this leaves room for the sqrt(2)*1.647 growth and keeps the
+ * precision of small vectors. The magnitude is scaled back after the loop.
+ * Max abs error measured against libm over 2M vectors of all magnitudes:
+ * angle 2.9e-8 rad, magnitude 1.1e-8 (24 LSB). The magnitude saturates at 1 (vectors outside the unit circle).
+ * atan2(0,0) is 0. */
+
+static inline fxpangle_t q31_atan2mag(q31_t y, q31_t x, q31_t *mag)
+{
+  int32_t t;
+  uint32_t ax, ay;
+  fxpangle_t z = 0;
+  int sh;
+  int i;
+
+  ax = (x < 0) ? (uint32_t)0 - (uint32_t)x : (uint32_t)x;
+  ay = (y < 0) ? (uint32_t)0 - (uint32_t)y : (uint32_t)y;
+  if((ax | ay) == 0)
+    {
+      if(mag)
+        {
+          *mag = 0;
+        }
+      return 0;
+    }
+
+  sh = fxp_clz32(ax | ay) - 3; /* -3..28 */
+  if(sh >= 0)
+    {
+      x *= (int32_t)1 << sh;
+      y *= (int32_t)1 << sh;
+    }
+  else
+    {
+      x >>= -sh;
+      y >>= -sh;
+    }
+
+  if(x < 0)
+    {
+      x = -x;
+      y = -y;
+      z = FXPANGLE_PI;
+    }
+
+  FXP_COUNT(FXP_OP_ITER, FXP_CORDIC_ITER);
+
+  for(i=0; i<FXP_CORDIC_ITER; i++)
+    {
+      if(y < 0)
+        {
+          t  = x - (y >> i);
+          y  = y + (x >> i);
+          z -= fxp_cordic_atan[i];
+        }
+      else
+        {
+          t  = x + (y >> i);
+          y  = y - (x >> i);
+          z += fxp_cordic_atan[i];
+        }
+      x = t;
+    }
+
+  if(mag)
+    {
+      *mag = q31_sat(((int64_t)x * FXP_CORDIC_K_Q31) >> (Q31BITS + sh));
+    }
+
+  return z;
+}
+
+static inline fxpangle_t q31_atan2(q31_t y, q31_t x)
+{
+  return q31_atan2mag(y, x, NULL);
+}
+
+/* Square roots, bit by bit (exact: result is floor(sqrt())) */
+
+static inline uint32_t fxp_isqrt32(uint32_t val)
+{
+  uint32_t res = 0;
+  uint32_t bit = 1UL << 30;
+
+  while(bit > val)
+    {
+      bit >>= 2;
+    }
+
+  while(bit)
+    {
+      FXP_COUNT(FXP_OP_ITER, 1);
+      if(val >= res + bit)
+        {
+          val -= res + bit;
+          res  = (res >> 1) + bit;
+        }
+      else
+        {
+          res >>= 1;
+        }
+      bit >>= 2;
+    }
+
+  return res;
+}
+
+static inline uint32_t fxp_isqrt64(uint64_t val)
+{
+  uint64_t res = 0;
+  uint64_t bit = 1ULL << 62;
+
+  while(bit > val)
+    {
+      bit >>= 2;
+    }
+
+  while(bit)
+    {
+      FXP_COUNT(FXP_OP_ITER, 1);
+      if(val >= res + bit)
+        {
+          val -= res + bit;
+          res  = (res >> 1) + bit;
+        }
+      else
+        {
+          res >>= 1;
+        }
+      bit >>= 2;
+    }
+
+  return (uint32_t)res;
+}
+
+/* Negative inputs return 0. Error <= 1 LSB. */
+
+static inline q15_t q15_sqrt(q15_t val)
+{
+  if(val <= 0)
+    return 0;
+  return (q15_t)fxp_isqrt32((uint32_t)val << Q15BITS);
+}
+
+static inline q31_t q31_sqrt(q31_t val)
+{
+  if(val <= 0)
+    return 0;
+  return (q31_t)fxp_isqrt64((uint64_t)val << Q31BITS);
+}
+
+/* Base 2 logarithm of an unsigned integer, result in Q16.16.
+ * Fractional bits are obtained by repeated squaring of the normalized
+ * mantissa. Error <= 1 LSB (2^-16). val=0 returns INT32_MIN. */
+
+static inline int32_t fxp_log2(uint32_t val)
+{
+  uint32_t m;
+  int32_t res;
+  int ip;
+  int i;
+
+  if(val == 0)
+    return INT32_MIN;
+
+  ip  = 31 - fxp_clz32(val);
+  m   = (val << (31 - ip)) >> 1; /* mantissa in [1,2) as Q30 */
+  res = ip << 16;
+
+  FXP_COUNT(FXP_OP_ITER, 16);
+
+  for(i=15; i>=0; i--)
+    {
+      m = (uint32_t)(((uint64_t)m * m) >> 30);
+      if(m >= (1UL << 31))
+        {
+          m >>= 1;
+          res |= 1L << i;
+        }
+    }
+
+  return res;
+}
+
+/* log2 of a positive Q31 value, result in Q16.16 (always <= 0) */
+
+static inline int32_t q31_log2(q31_t val)
+{
+  if(val <= 0)
+    return INT32_MIN;
+  return fxp_log2((uint32_t)val) - (Q31BITS << 16);
 }
 
 #endif /* FXPMATH__H */
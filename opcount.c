@@ -0,0 +1,198 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Operation count profiling: counters, cost tables and report.
+ * Counters are global: profile a single encoder thread at a time. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fxpmath.h"
+#include "opcount.h"
+
+uint64_t fxp_opcounts[FXP_MAXSTAGES][FXP_OP_COUNT];
+int fxp_opstage;
+
+static const char * const opnames[FXP_OP_COUNT] =
+{
+  "add15", "add31", "mul15", "mul31", "sat", "cmul15", "cmul31", "mac", "iter", "mem"
+};
+
+static const char * const stagenames[C2PROF_STAGES] =
+{
+  "other", "resample", "input", "square", "notch", "fir", "window", "fft", "peak", "acf", "history"
+};
+
+/* Built-in cost tables. Estimates for code compiled from the C primitives,
+ * order:  add15 add31 mul15 mul31 sat cmul15 cmul31 mac iter mem
+ * m4: QADD/SSAT/SMULBB/SMMULR/SMLAL single cycle DSP instructions,
+ *     loads and stores 2 cycles per sample moved.
+ * m0: no saturation instructions, 32x32->64 bit multiply in software.
+ * ops: unit cost, reports raw operation counts. */
+
+static const struct c2prof_cost_s costs[] =
+{
+  { "m4",   168.0, { 1, 1, 2,  3, 1,  4, 10,  1, 4, 2 } },
+  { "m0",    48.0, { 4, 8, 5, 24, 4, 26, 110, 8, 8, 3 } },
+  { "ops",    0.0, { 1, 1, 1,  1, 1,  1,  1,  1, 1, 1 } },
+};
+
+/* ========================================================================== */
+void c2prof_reset(void)
+{
+  memset(fxp_opcounts, 0, sizeof(fxp_opcounts));
+  fxp_opstage = C2PROF_OTHER;
+}
+
+/* ========================================================================== */
+/*
+ * Find a built-in cost table by name.
+ */
+const struct c2prof_cost_s *c2prof_cost(const char *name)
+{
+  uint32_t i;
+
+  for(i=0; i<sizeof(costs)/sizeof(costs[0]); i++)
+    {
+      if(!strcmp(costs[i].name, name))
+        {
+          return &costs[i];
+        }
+    }
+
+  return NULL;
+}
+
+/* ========================================================================== */
+/*
+ * Load a cost table from a text file. Each line is "<key> <value>", key is
+ * an operation name (see opnames) or "mhz". Missing operations cost 1 cycle,
+ * '#' starts a comment.
+ * Returns 0 on success, -1 on error.
+ */
+int c2prof_loadcost(struct c2prof_cost_s *cost, const char *path)
+{
+  FILE *f;
+  char line[128];
+  char key[32];
+  double val;
+  int lineno = 0;
+  int i;
+
+  f = fopen(path, "r");
+  if(!f)
+    {
+      return -1;
+    }
+
+  memset(cost, 0, sizeof(*cost));
+  strncpy(cost->name, path, sizeof(cost->name) - 1);
+  for(i=0; i<FXP_OP_COUNT; i++)
+    {
+      cost->cycles[i] = 1;
+    }
+
+  while(fgets(line, sizeof(line), f))
+    {
+      lineno++;
+      if(line[0] == '#' || sscanf(line, "%31s %lf", key, &val) != 2)
+        {
+          continue;
+        }
+
+      if(!strcmp(key, "mhz"))
+        {
+          cost->mhz = val;
+          continue;
+        }
+
+      for(i=0; i<FXP_OP_COUNT; i++)
+        {
+          if(!strcmp(key, opnames[i]))
+            {
+              cost->cycles[i] = val;
+              break;
+            }
+        }
+
+      if(i == FXP_OP_COUNT)
+        {
+          fprintf(stderr, "%s:%d: unknown operation '%s'\n", path, lineno, key);
+          fclose(f);
+          return -1;
+        }
+    }
+
+  fclose(f);
+  return 0;
+}
+
+/* ========================================================================== */
+/*
+ * Print operations per frame for each stage, and the projected cycles per
+ * frame for the given target.
+ */
+void c2prof_report(FILE *out, uint32_t nframes, const struct c2prof_cost_s *cost)
+{
+  double cycles, stagecycles, total = 0;
+  int s, op;
+
+  if(nframes == 0)
+    {
+      return;
+    }
+
+  fprintf(out, "operations per frame (%u frames), cycles for target %s\n", nframes, cost->name);
+  fprintf(out, "%-9s", "stage");
+  for(op=0; op<FXP_OP_COUNT; op++)
+    {
+      fprintf(out, " %8s", opnames[op]);
+    }
+  fprintf(out, " %10s\n", "cycles");
+
+  for(s=0; s<C2PROF_STAGES; s++)
+    {
+      stagecycles = 0;
+      for(op=0; op<FXP_OP_COUNT; op++)
+        {
+          stagecycles += fxp_opcounts[s][op] * cost->cycles[op];
+        }
+      if(stagecycles == 0)
+        {
+          continue;
+        }
+
+      fprintf(out, "%-9s", stagenames[s]);
+      for(op=0; op<FXP_OP_COUNT; op++)
+        {
+          fprintf(out, " %8.1f", (double)fxp_opcounts[s][op] / nframes);
+        }
+      cycles = stagecycles / nframes;
+      fprintf(out, " %10.0f\n", cycles);
+      total += cycles;
+    }
+
+  fprintf(out, "total %.0f cycles per frame", total);
+  if(cost->mhz > 0)
+    {
+      /* A frame is 10 ms of speech */
+      fprintf(out, ", %.1f%% of a %.0f MHz core", 100.0 * total / (cost->mhz * 1e4), cost->mhz);
+    }
+  fprintf(out, "\n");
+}
@@ -0,0 +1,59 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Operation count profiling: encoder stages and target cost tables */
+
+#ifndef __OPCOUNT__H__
+#define __OPCOUNT__H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "fxpmath.h"
+
+/* Stages the encoder attributes its operations to, see FXP_STAGE() */
+
+enum c2prof_stage_e
+{
+  C2PROF_OTHER,
+  C2PROF_RESAMPLE, /* input resampler */
+  C2PROF_INPUT,    /* partial frame accumulator copies */
+  C2PROF_SQUARE,   /* NLP: squaring */
+  C2PROF_NOTCH,    /* NLP: DC notch */
+  C2PROF_FIR,      /* NLP: 600 Hz low pass FIR */
+  C2PROF_WINDOW,   /* NLP: decimation, window, scaling, padding */
+  C2PROF_FFT,      /* NLP: FFT */
+  C2PROF_PEAK,     /* NLP: peak search */
+  C2PROF_ACF,      /* ACF: autocorrelation pitch search */
+  C2PROF_HISTORY,  /* NLP: rolling window shift */
+  C2PROF_STAGES
+};
+
+/* Cycles per operation for a target, indexed by enum fxp_op_e */
+
+struct c2prof_cost_s
+{
+  char   name[32];
+  double mhz; /* core clock, gives the real time budget */
+  double cycles[FXP_OP_COUNT];
+};
+
+void c2prof_reset(void);
+const struct c2prof_cost_s *c2prof_cost(const char *name);
+int c2prof_loadcost(struct c2prof_cost_s *cost, const char *path);
+void c2prof_report(FILE *out, uint32_t nframes, const struct c2prof_cost_s *cost);
+
+#endif /* __OPCOUNT__H__ */
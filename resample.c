@@ -0,0 +1,147 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Streaming polyphase resampler to the 8 kHz codec rate */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "fxpmath.h"
+#include "resample.h"
+#include "opcount.h"
+
+/* 120 tap 3600 Hz low pass FIR at 48 kHz, Hamming windowed sinc.
+ * -2.5 dB at 3400 Hz, -22 dB at 4000 Hz, < -53 dB above 4400 Hz.
+ * Normalized to unity DC gain, stored value is round(32768 * h). */
+static const q15_t rsproto[C2RS_TAPS] =
+{
+      3,     9,    14,    16,    14,    10,     2,    -8,
+    -19,   -26,   -29,   -25,   -14,     3,    24,    43,
+     56,    57,    44,    18,   -19,   -59,   -92,  -108,
+   -101,   -67,   -11,    58,   125,   173,   187,   158,
+     86,   -19,  -137,  -241,  -304,  -304,  -231,   -90,
+     97,   292,   449,   526,   489,   327,    54,  -288,
+   -632,  -898, -1005,  -889,  -512,   122,   970,  1947,
+   2943,  3833,  4502,  4861,  4861,  4502,  3833,  2943,
+   1947,   970,   122,  -512,  -889, -1005,  -898,  -632,
+   -288,    54,   327,   489,   526,   449,   292,    97,
+    -90,  -231,  -304,  -304,  -241,  -137,   -19,    86,
+    158,   187,   173,   125,    58,   -11,   -67,  -101,
+   -108,   -92,   -59,   -19,    18,    44,    57,    56,
+     43,    24,     3,   -14,   -25,   -29,   -26,   -19,
+     -8,     2,    10,    14,    16,    14,     9,     3,
+};
+
+/* ========================================================================== */
+/*
+ * Initialize the resampler for a given input rate.
+ * Returns 0 on success, -1 if the rate is not supported.
+ */
+int c2rs_init(struct c2rs_s *rs, uint32_t rate)
+{
+  if(rate == 0 || rate < C2RS_OUTRATE || C2RS_PROTORATE % rate)
+    {
+      return -1;
+    }
+
+  rs->rate  = rate;
+  rs->up    = C2RS_PROTORATE / rate;
+  rs->phase = 0;
+  rs->pos   = 0;
+  memset(rs->hist, 0, sizeof(rs->hist));
+
+  return 0;
+}
+
+/* ========================================================================== */
+/*
+ * Compute one output sample from the filter phase p.
+ * y = L * sum(h[p + i*L] * x[j - i])
+ */
+static inline int16_t c2rs_phase(struct c2rs_s *rs, uint32_t p)
+{
+  const q15_t *x = rs->hist + rs->pos;
+  int64_t acc = 0;
+  uint32_t k;
+
+  for(k = p; k < C2RS_TAPS; k += rs->up)
+    {
+      FXP_COUNT(FXP_OP_MAC, 1);
+      acc += (int32_t)rsproto[k] * (int32_t)*x++;
+    }
+
+  acc *= rs->up;
+  acc += 1L << (Q15BITS - 1); /* Rounding */
+
+  return q15_sat((int32_t)(acc >> Q15BITS));
+}
+
+/* ========================================================================== */
+/*
+ * Resample nin samples from in to at most maxout samples in out.
+ * Input consumption stops before a sample that would produce an output
+ * sample that does not fit, so a caller can resample directly into a
+ * fixed size frame and resume with the remaining input.
+ * Returns the number of output samples, *consumed receives the number of
+ * input samples used.
+ */
+uint32_t c2rs_process(struct c2rs_s *rs, const int16_t *in, uint32_t nin,
+                      uint32_t *consumed, int16_t *out, uint32_t maxout)
+{
+  uint32_t i;
+  uint32_t nout = 0;
+
+  FXP_STAGE(C2PROF_RESAMPLE);
+
+  if(rs->up == C2RS_DECIM)
+    {
+      /* 8 kHz input, nothing to filter */
+
+      i = (nin < maxout) ? nin : maxout;
+      FXP_COUNT(FXP_OP_MEM, i);
+      memcpy(out, in, i * sizeof(int16_t));
+      *consumed = i;
+      return i;
+    }
+
+  for(i = 0; i < nin; i++)
+    {
+      if(rs->phase < rs->up && nout == maxout)
+        {
+          break;
+        }
+
+      /* Push the sample, newest first */
+
+      FXP_COUNT(FXP_OP_MEM, 2);
+      rs->pos = (rs->pos == 0) ? (C2RS_TAPS - 1) : (rs->pos - 1);
+      rs->hist[rs->pos]             = in[i];
+      rs->hist[rs->pos + C2RS_TAPS] = in[i];
+
+      /* At most one output per input since L <= 6 */
+
+      if(rs->phase < rs->up)
+        {
+          out[nout++] = c2rs_phase(rs, rs->phase);
+          rs->phase += C2RS_DECIM;
+        }
+      rs->phase -= rs->up;
+    }
+
+  *consumed = i;
+  return nout;
+}
@@ -0,0 +1,59 @@
+/*
+ * c2fxp - codec2 fixed point encoder/decoder.
+ * Copyright (C) 2017  Sebastien F4GRX <f4grx@f4grx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Streaming polyphase resampler to the 8 kHz codec rate */
+
+#ifndef __RESAMPLE__H__
+#define __RESAMPLE__H__
+
+#include <stdint.h>
+#include "fxpmath.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The prototype low pass filter runs at 48 kHz. Any input rate that divides
+ * 48000 with an integer ratio L (1..6) is supported: the input is (virtually)
+ * upsampled by L, filtered, and decimated by 6. Only the taps that meet
+ * non-zero samples of the upsampled signal are computed (one filter phase),
+ * and only for the output samples that are kept.
+ * 48000, 24000, 16000, 12000 and 9600 Hz are resampled, 8000 Hz is copied. */
+
+#define C2RS_PROTORATE 48000
+#define C2RS_OUTRATE   8000
+#define C2RS_DECIM     (C2RS_PROTORATE / C2RS_OUTRATE)
+#define C2RS_TAPS      120
+
+struct c2rs_s
+{
+  uint32_t rate;  /* input rate */
+  uint16_t up;    /* upsampling ratio L */
+  uint16_t phase; /* prototype filter phase of the next output sample */
+  uint16_t pos;   /* position of the newest sample in hist */
+  q15_t hist[2*C2RS_TAPS]; /* input history, mirrored to avoid wrapping */
+};
+
+C2FXP_API int c2rs_init(struct c2rs_s *rs, uint32_t rate);
+C2FXP_API uint32_t c2rs_process(struct c2rs_s *rs, const int16_t *in, uint32_t nin,
+                      uint32_t *consumed, int16_t *out, uint32_t maxout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RESAMPLE__H__ */